@@ -0,0 +1,382 @@
+#include "asynccookbookdatabase.h"
+#include "recipe.h"
+#include <QPointer>
+#include <QSocketNotifier>
+#include <QDebug>
+#include <algorithm>
+using namespace std;
+
+AsyncCookBookDatabase::AsyncCookBookDatabase(QObject* parent)
+    : AsyncRecipeRepository(parent), state_(Disconnected), inFlight_(false), currentFailed_(false),
+      readNotifier_(nullptr), writeNotifier_(nullptr) {}
+
+AsyncCookBookDatabase::~AsyncCookBookDatabase() {
+    // Уведомители должны исчезнуть раньше, чем закроется сокет соединения
+    delete readNotifier_;
+    delete writeNotifier_;
+}
+
+void AsyncCookBookDatabase::connectToServer() {
+    if (state_ != Disconnected) return;
+    
+    session_.conn_ = PQconnectStart(CookBookDatabase::connectionInfo());
+    
+    if (!session_.conn_ || PQstatus(session_.conn_) == CONNECTION_BAD) {
+        fail(QString::fromStdString(session_.conn_ ? PQerrorMessage(session_.conn_) : "Нет памяти для соединения"));
+        return;
+    }
+    
+    state_ = Connecting;
+    
+    // После PQconnectStart ждем готовности сокета к записи, как после PGRES_POLLING_WRITING
+    watchSocket(false, true);
+}
+
+void AsyncCookBookDatabase::pollConnection() {
+    switch (PQconnectPoll(session_.conn_)) {
+    case PGRES_POLLING_READING:
+        watchSocket(true, false);
+        break;
+    case PGRES_POLLING_WRITING:
+        watchSocket(false, true);
+        break;
+    case PGRES_POLLING_OK:
+        onConnectionEstablished();
+        break;
+    default:
+        fail(QString::fromStdString(PQerrorMessage(session_.conn_)));
+        break;
+    }
+}
+
+void AsyncCookBookDatabase::onConnectionEstablished() {
+    PQsetnonblocking(session_.conn_, 1);
+    watchSocket(true, false);
+    state_ = Preparing;
+    
+    // Подготовка каталога запросов и подписка на изменения идут первыми,
+    // до уже накопившихся запросов
+    Request prepare;
+    prepare.queue = [](CookBookDatabase& db) { return db.queuePrepareStatements() && db.queueListen(); };
+    prepare.finish = [this](CookBookDatabase& db, const PGresults&, bool ok) {
+        if (!ok) {
+            // При обрыве соединения fail() уже вызван и сообщил об ошибке
+            if (state_ != Disconnected) {
+                fail(QString::fromStdString(db.getLastError()));
+            }
+            return;
+        }
+        
+        // С этого момента чужие изменения удаляют записи кэша
+        db.setListening(true);
+        state_ = Ready;
+        emit connected();
+    };
+    pending_.push_front(move(prepare));
+    
+    startNext();
+}
+
+void AsyncCookBookDatabase::getRecipeById(int id, QObject* context, function<void(shared_ptr<Recipe>)> callback) {
+    // Запись кэша, которой можно верить, отдается сразу, без очереди
+    int knownVersion = 0;
+    shared_ptr<Recipe> cached = session_.cachedRecipe(id, &knownVersion);
+    if (cached && knownVersion == 0) {
+        callback(cached);
+        return;
+    }
+    
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [id, knownVersion](CookBookDatabase& db) { return db.queueRecipeById(id, knownVersion); };
+    request.finish = [id, cached, knownVersion, guard, callback](CookBookDatabase& db, const PGresults& results, bool ok) {
+        if (!guard) return;
+        callback(ok ? db.readRecipeById(id, results, cached, knownVersion) : nullptr);
+    };
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::getAllRecipes(int parts, QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) {
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [parts](CookBookDatabase& db) { return db.queueAllRecipes(parts); };
+    request.finish = [parts, guard, callback](CookBookDatabase& db, const PGresults& results, bool ok) {
+        if (!guard) return;
+        callback(ok ? db.readAllRecipes(parts, results) : vector<shared_ptr<Recipe>>());
+    };
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::getAllTags(QObject* context, function<void(vector<string>)> callback) {
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [](CookBookDatabase& db) { return db.queueAllTags(); };
+    request.finish = [guard, callback](CookBookDatabase& db, const PGresults& results, bool ok) {
+        if (!guard) return;
+        callback(ok ? db.readAllTags(results) : vector<string>());
+    };
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit,
+                                         QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) {
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [filter, afterKey, limit](CookBookDatabase& db) {
+        return db.queueQueryRecipes(filter, afterKey, limit);
+    };
+    request.finish = [guard, callback](CookBookDatabase& db, const PGresults& results, bool ok) {
+        if (!guard) return;
+        callback(ok ? db.readQueryRecipes(results) : vector<shared_ptr<Recipe>>());
+    };
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::searchRecipes(const string& text, const vector<string>& tags, int limit,
+                                          const vector<int>& within, QObject* context,
+                                          function<void(vector<RecipeSearchResult>)> callback) {
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [text, tags, limit, within](CookBookDatabase& db) {
+        return db.queueSearchRecipes(text, tags, limit, within);
+    };
+    request.finish = [guard, callback](CookBookDatabase& db, const PGresults& results, bool ok) {
+        if (!guard) return;
+        callback(ok ? db.readSearchRecipes(results) : vector<RecipeSearchResult>());
+    };
+    request.replaceKey = "search";
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::streamRecipes(QObject* context, function<void(Recipe)> row, function<void(bool)> done) {
+    QPointer<QObject> guard(context);
+    
+    Request request;
+    request.queue = [](CookBookDatabase& db) { return db.queueRecipeStream(); };
+    request.row = [guard, row](CookBookDatabase&, const PGresult* res) {
+        if (!guard) return;
+        for (int i = 0; i < PQntuples(res); ++i) {
+            row(CookBookDatabase::readStreamedRecipe(res, i));
+        }
+    };
+    request.finish = [guard, row, done](CookBookDatabase&, const PGresults& results, bool ok) {
+        if (!guard) return;
+        
+        // Без построчного режима все строки остаются в итоговом результате
+        if (ok && !results.empty()) {
+            const PGresult* res = results[0].get();
+            for (int i = 0; i < PQntuples(res); ++i) {
+                row(CookBookDatabase::readStreamedRecipe(res, i));
+            }
+        }
+        done(ok);
+    };
+    enqueue(move(request));
+}
+
+void AsyncCookBookDatabase::enqueue(Request request) {
+    if (!request.replaceKey.empty()) {
+        const string& key = request.replaceKey;
+        pending_.erase(remove_if(pending_.begin(), pending_.end(),
+                                 [&key](const Request& queued) { return queued.replaceKey == key; }),
+                       pending_.end());
+    }
+    pending_.push_back(move(request));
+    
+    // После обрыва соединения переподключаемся при первом новом запросе
+    if (state_ == Disconnected) {
+        connectToServer();
+        return;
+    }
+    
+    startNext();
+}
+
+void AsyncCookBookDatabase::startNext() {
+    if (inFlight_ || pending_.empty()) return;
+    if (state_ == Disconnected || state_ == Connecting) return;
+    
+    current_ = move(pending_.front());
+    pending_.pop_front();
+    
+    if (!session_.beginPipeline()) {
+        fail(QString::fromStdString(session_.getLastError()));
+        return;
+    }
+    
+    // Даже если запрос не удалось поставить целиком, конвейер закрываем точкой синхронизации
+    currentFailed_ = !current_.queue(session_);
+    inFlight_ = true;
+    
+    // Построчный режим включается до первого чтения результатов
+    if (current_.row && !currentFailed_) {
+        PQsetSingleRowMode(session_.conn_);
+    }
+    results_.clear();
+    
+    if (PQpipelineSync(session_.conn_) != 1) {
+        fail(QString::fromStdString(PQerrorMessage(session_.conn_)));
+        return;
+    }
+    
+    flush();
+}
+
+void AsyncCookBookDatabase::flush() {
+    int status = PQflush(session_.conn_);
+    
+    if (status == -1) {
+        fail(QString::fromStdString(PQerrorMessage(session_.conn_)));
+        return;
+    }
+    
+    // 1 — в буфере остались данные, дописываем по готовности сокета
+    writeNotifier_->setEnabled(status == 1);
+}
+
+void AsyncCookBookDatabase::onWritable() {
+    if (state_ == Connecting) {
+        pollConnection();
+        return;
+    }
+    
+    flush();
+}
+
+void AsyncCookBookDatabase::onReadable() {
+    if (state_ == Connecting) {
+        pollConnection();
+        return;
+    }
+    
+    PGconn* conn = session_.conn_;
+    if (PQconsumeInput(conn) != 1) {
+        fail(QString::fromStdString(PQerrorMessage(conn)));
+        return;
+    }
+    
+    // Забираем только то, что уже пришло: PQgetResult не блокирует, пока PQisBusy == 0
+    bool boundary = false;
+    while (inFlight_ && !PQisBusy(conn)) {
+        PGresult* res = PQgetResult(conn);
+        
+        if (!res) {
+            // NULL отделяет результаты соседних запросов; два подряд — данных больше нет
+            if (boundary) break;
+            boundary = true;
+            continue;
+        }
+        boundary = false;
+        
+        ExecStatusType status = PQresultStatus(res);
+        if (status == PGRES_PIPELINE_SYNC) {
+            PQclear(res);
+            finishCurrent(!currentFailed_);
+            continue;
+        }
+        
+        if (status == PGRES_SINGLE_TUPLE) {
+            PGresultPtr row(res);
+            if (current_.row) {
+                current_.row(session_, row.get());
+            }
+            continue;
+        }
+        
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+            if (status != PGRES_PIPELINE_ABORTED) {
+                session_.lastError_ = PQresultErrorMessage(res);
+            }
+            currentFailed_ = true;
+        }
+        
+        results_.emplace_back(res);
+    }
+    
+    // Уведомления приходят и между запросами: сокет на чтение слушается всегда
+    for (const auto& notification : session_.takeNotifications()) {
+        emit changeNotified(notification);
+    }
+}
+
+void AsyncCookBookDatabase::finishCurrent(bool success) {
+    PQexitPipelineMode(session_.conn_);
+    session_.pipelineQueued_ = 0;
+    inFlight_ = false;
+    
+    Request done = move(current_);
+    PGresults results = move(results_);
+    results_.clear();
+    
+    if (done.finish) {
+        done.finish(session_, results, success);
+    }
+    
+    startNext();
+}
+
+void AsyncCookBookDatabase::fail(const QString& message) {
+    qDebug() << "Ошибка асинхронного соединения:" << message;
+    
+    dropNotifiers();
+    session_.disconnect();
+    state_ = Disconnected;
+    inFlight_ = false;
+    results_.clear();
+    
+    // Сообщаем об отказе всем ожидающим, чтобы интерфейс не ждал вечно
+    deque<Request> aborted;
+    if (current_.finish) {
+        aborted.push_back(move(current_));
+        current_ = Request();
+    }
+    while (!pending_.empty()) {
+        aborted.push_back(move(pending_.front()));
+        pending_.pop_front();
+    }
+    
+    PGresults none;
+    for (auto& request : aborted) {
+        if (request.finish) {
+            request.finish(session_, none, false);
+        }
+    }
+    
+    emit errorOccurred(message);
+}
+
+void AsyncCookBookDatabase::watchSocket(bool read, bool write) {
+    int socket = PQsocket(session_.conn_);
+    
+    // Во время подключения libpq может сменить сокет — пересоздаем уведомители
+    if (!readNotifier_ || readNotifier_->socket() != socket) {
+        dropNotifiers();
+        
+        readNotifier_ = new QSocketNotifier(socket, QSocketNotifier::Read, this);
+        writeNotifier_ = new QSocketNotifier(socket, QSocketNotifier::Write, this);
+        
+        connect(readNotifier_, &QSocketNotifier::activated, this, &AsyncCookBookDatabase::onReadable);
+        connect(writeNotifier_, &QSocketNotifier::activated, this, &AsyncCookBookDatabase::onWritable);
+    }
+    
+    readNotifier_->setEnabled(read);
+    writeNotifier_->setEnabled(write);
+}
+
+void AsyncCookBookDatabase::dropNotifiers() {
+    // Вызывается и из обработчика самого уведомителя, поэтому удаляем отложенно
+    for (QSocketNotifier* notifier : {readNotifier_, writeNotifier_}) {
+        if (notifier) {
+            notifier->setEnabled(false);
+            notifier->deleteLater();
+        }
+    }
+    
+    readNotifier_ = nullptr;
+    writeNotifier_ = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include "asyncreciperepository.h"
+#include "cookbookdatabase.h"
+using namespace std;
+
+class QSocketNotifier;
+
+// Неблокирующий доступ к БД: отдельное соединение libpq, которое опрашивается
+// из цикла событий Qt через QSocketNotifier. Запросы выполняются по очереди,
+// каждый одним конвейером; результат передается в callback в потоке GUI.
+// Callback не вызывается, если объект context к этому моменту уничтожен.
+class AsyncCookBookDatabase : public AsyncRecipeRepository {
+    Q_OBJECT
+
+public:
+    explicit AsyncCookBookDatabase(QObject* parent = nullptr);
+    ~AsyncCookBookDatabase() override;
+
+    void connectToServer() override;
+    bool isReady() const override { return state_ == Ready; }
+
+    void setRecipeCache(shared_ptr<RecipeCache> cache) { session_.setRecipeCache(move(cache)); }
+    
+    // Рецепт из кэша приходит в callback сразу, до возврата из вызова
+    void getRecipeById(int id, QObject* context, function<void(shared_ptr<Recipe>)> callback) override;
+    void getAllRecipes(int parts, QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) override;
+    void getAllTags(QObject* context, function<void(vector<string>)> callback) override;
+    void queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit,
+                      QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) override;
+    
+    // Новый поиск вытесняет из очереди еще не отправленный прежний: его callback
+    // уже не вызывается, ответ на устаревший текст никому не нужен
+    void searchRecipes(const string& text, const vector<string>& tags, int limit, const vector<int>& within,
+                       QObject* context, function<void(vector<RecipeSearchResult>)> callback) override;
+    
+    // Рецепты с тегами приходят в row по одному, пока идет выборка; done — в конце
+    void streamRecipes(QObject* context, function<void(Recipe)> row, function<void(bool)> done) override;
+
+    string getLastError() const override { return session_.getLastError(); }
+
+private:
+    enum State { Disconnected, Connecting, Preparing, Ready };
+
+    struct Request {
+        function<bool(CookBookDatabase&)> queue;
+        function<void(CookBookDatabase&, const PGresults&, bool)> finish;
+        // Если задан, первый запрос читается построчно и строки не копятся в results_
+        function<void(CookBookDatabase&, const PGresult*)> row;
+        // Ожидающий запрос с тем же непустым ключом заменяется новым
+        string replaceKey;
+    };
+
+    void enqueue(Request request);
+    void startNext();
+    void pollConnection();
+    void onConnectionEstablished();
+    void onReadable();
+    void onWritable();
+    void flush();
+    void finishCurrent(bool success);
+    void fail(const QString& message);
+    void watchSocket(bool read, bool write);
+    void dropNotifiers();
+
+    CookBookDatabase session_;
+    State state_;
+    deque<Request> pending_;
+    Request current_;
+    bool inFlight_;
+    bool currentFailed_;
+    PGresults results_;
+    QSocketNotifier* readNotifier_;
+    QSocketNotifier* writeNotifier_;
+};
\ No newline at end of file
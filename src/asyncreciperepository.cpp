@@ -0,0 +1,94 @@
+#include "asyncreciperepository.h"
+#include <QThreadPool>
+using namespace std;
+
+AsyncRepositoryAdapter::AsyncRepositoryAdapter(shared_ptr<RecipeRepository> repository, QObject* parent)
+    : AsyncRecipeRepository(parent), repository_(move(repository)), workers_(new QThreadPool(this)),
+      searchGeneration_(0) {
+    // Один поток сохраняет порядок запросов, как очередь соединения libpq
+    workers_->setMaxThreadCount(1);
+}
+
+AsyncRepositoryAdapter::~AsyncRepositoryAdapter() {
+    // Задачи обращаются к адаптеру, поэтому он ждет их завершения;
+    // ответы, которые они успели отправить, удаляются вместе с ним
+    workers_->waitForDone();
+}
+
+void AsyncRepositoryAdapter::connectToServer() {
+    QMetaObject::invokeMethod(this, [this]() { emit connected(); }, Qt::QueuedConnection);
+}
+
+void AsyncRepositoryAdapter::run(function<void(RecipeRepository&)> job) {
+    shared_ptr<RecipeRepository> repository = repository_;
+    workers_->start([repository, job]() { job(*repository); });
+}
+
+void AsyncRepositoryAdapter::post(const QPointer<QObject>& context, function<void()> finish) {
+    // Ответ идет через адаптер: он живет дольше фоновых задач, а context
+    // проверяется уже в потоке GUI
+    QMetaObject::invokeMethod(this, [context, finish]() {
+        if (context) {
+            finish();
+        }
+    }, Qt::QueuedConnection);
+}
+
+void AsyncRepositoryAdapter::getRecipeById(int id, QObject* context, function<void(shared_ptr<Recipe>)> callback) {
+    QPointer<QObject> guard(context);
+    run([this, id, guard, callback](RecipeRepository& repository) {
+        shared_ptr<Recipe> recipe = repository.getRecipeById(id);
+        post(guard, [callback, recipe]() { callback(recipe); });
+    });
+}
+
+void AsyncRepositoryAdapter::getAllRecipes(int parts, QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) {
+    QPointer<QObject> guard(context);
+    run([this, parts, guard, callback](RecipeRepository& repository) {
+        auto recipes = make_shared<vector<shared_ptr<Recipe>>>(repository.getAllRecipes(parts));
+        post(guard, [callback, recipes]() { callback(move(*recipes)); });
+    });
+}
+
+void AsyncRepositoryAdapter::getAllTags(QObject* context, function<void(vector<string>)> callback) {
+    QPointer<QObject> guard(context);
+    run([this, guard, callback](RecipeRepository& repository) {
+        auto tags = make_shared<vector<string>>(repository.getAllTags());
+        post(guard, [callback, tags]() { callback(move(*tags)); });
+    });
+}
+
+void AsyncRepositoryAdapter::queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit,
+                                          QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) {
+    QPointer<QObject> guard(context);
+    run([this, filter, afterKey, limit, guard, callback](RecipeRepository& repository) {
+        auto page = make_shared<vector<shared_ptr<Recipe>>>(repository.queryRecipes(filter, afterKey, limit));
+        post(guard, [callback, page]() { callback(move(*page)); });
+    });
+}
+
+void AsyncRepositoryAdapter::searchRecipes(const string& text, const vector<string>& tags, int limit,
+                                           const vector<int>& within, QObject* context,
+                                           function<void(vector<RecipeSearchResult>)> callback) {
+    QPointer<QObject> guard(context);
+    int generation = ++searchGeneration_;
+    run([this, text, tags, limit, within, generation, guard, callback](RecipeRepository& repository) {
+        // Пока поиск ждал очереди, пришел новый текст
+        if (generation != searchGeneration_) return;
+        
+        auto results = make_shared<vector<RecipeSearchResult>>(repository.searchRecipes(text, tags, limit, within));
+        post(guard, [callback, results]() { callback(move(*results)); });
+    });
+}
+
+void AsyncRepositoryAdapter::streamRecipes(QObject* context, function<void(Recipe)> row, function<void(bool)> done) {
+    QPointer<QObject> guard(context);
+    run([this, guard, row, done](RecipeRepository& repository) {
+        bool ok = repository.forEachRecipe([this, guard, row](Recipe&& recipe) {
+            auto moved = make_shared<Recipe>(move(recipe));
+            post(guard, [row, moved]() { row(move(*moved)); });
+            return true;
+        });
+        post(guard, [done, ok]() { done(ok); });
+    });
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "recipe.h"
+#include "reciperepository.h"
+using namespace std;
+
+class QThreadPool;
+
+// Неблокирующий доступ к хранилищу рецептов для окна, диалога и модели списка:
+// результат передается в callback в потоке GUI. Callback не вызывается, если
+// объект context к этому моменту уничтожен
+class AsyncRecipeRepository : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AsyncRecipeRepository(QObject* parent = nullptr) : QObject(parent) {}
+    
+    virtual void connectToServer() = 0;
+    virtual bool isReady() const = 0;
+    
+    virtual void getRecipeById(int id, QObject* context, function<void(shared_ptr<Recipe>)> callback) = 0;
+    virtual void getAllRecipes(int parts, QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) = 0;
+    virtual void getAllTags(QObject* context, function<void(vector<string>)> callback) = 0;
+    virtual void queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit,
+                              QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) = 0;
+    
+    // Новый поиск вытесняет еще не начатый прежний: его callback уже не вызывается
+    virtual void searchRecipes(const string& text, const vector<string>& tags, int limit, const vector<int>& within,
+                               QObject* context, function<void(vector<RecipeSearchResult>)> callback) = 0;
+    
+    // Рецепты с тегами приходят в row по одному, пока идет выборка; done — в конце
+    virtual void streamRecipes(QObject* context, function<void(Recipe)> row, function<void(bool)> done) = 0;
+    
+    virtual string getLastError() const = 0;
+
+signals:
+    // После переподключения тоже: пропущенные за это время уведомления потеряны
+    void connected();
+    void errorOccurred(const QString& message);
+    // Изменение в хранилище, сделанное любым клиентом, в том числе этим
+    void changeNotified(const ChangeNotification& notification);
+};
+
+// Неблокирующий доступ поверх любого RecipeRepository, например
+// MemoryRecipeRepository: запросы по очереди выполняются в фоновом потоке,
+// ответы возвращаются в поток GUI. Хранилище должно допускать вызовы
+// из нескольких потоков — окно пишет в него напрямую. Уведомлений о чужих
+// записях нет: других клиентов у такого хранилища нет
+class AsyncRepositoryAdapter : public AsyncRecipeRepository {
+    Q_OBJECT
+
+public:
+    explicit AsyncRepositoryAdapter(shared_ptr<RecipeRepository> repository, QObject* parent = nullptr);
+    ~AsyncRepositoryAdapter() override;
+    
+    // Хранилище уже открыто: connected приходит из цикла событий сразу
+    void connectToServer() override;
+    bool isReady() const override { return true; }
+    
+    void getRecipeById(int id, QObject* context, function<void(shared_ptr<Recipe>)> callback) override;
+    void getAllRecipes(int parts, QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) override;
+    void getAllTags(QObject* context, function<void(vector<string>)> callback) override;
+    void queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit,
+                      QObject* context, function<void(vector<shared_ptr<Recipe>>)> callback) override;
+    void searchRecipes(const string& text, const vector<string>& tags, int limit, const vector<int>& within,
+                       QObject* context, function<void(vector<RecipeSearchResult>)> callback) override;
+    void streamRecipes(QObject* context, function<void(Recipe)> row, function<void(bool)> done) override;
+    
+    string getLastError() const override { return repository_->getLastError(); }
+
+private:
+    // job выполняется в фоновом потоке, finish — в потоке GUI, если context жив
+    void run(function<void(RecipeRepository&)> job);
+    void post(const QPointer<QObject>& context, function<void()> finish);
+    
+    shared_ptr<RecipeRepository> repository_;
+    QThreadPool* workers_;
+    atomic<int> searchGeneration_;
+};
\ No newline at end of file
@@ -1,349 +1,1778 @@
 #include "cookbookdatabase.h"
 #include "recipe.h"
+#include "recipecache.h"
 #include <iostream>
 #include <sstream>
 #include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
-CookBookDatabase::CookBookDatabase() : conn_(nullptr) {}
+namespace {
+
+// OID базовых типов PostgreSQL (из pg_type.dat)
+const Oid INT4_OID = 23;
+const Oid TEXT_OID = 25;
+const Oid INT4_ARRAY_OID = 1007;
+const Oid TEXT_ARRAY_OID = 1009;
+
+const int MAX_STATEMENT_PARAMS = 6;
+
+// Конфигурация полнотекстового поиска; должна совпадать с recipe_search_vector в миграциях
+#define SEARCH_CONFIG "'russian'"
+
+// Канал уведомлений об изменениях; триггеры из миграций пишут в него
+// "I <id>", "U <id>", "D <id>" для рецептов и "T <id>" для тегов
+#define CHANGE_CHANNEL "recipe_changes"
+
+// Условие дочерних запросов рецепта: версия в базе отличается от известной ($2)
+#define RECIPE_CHANGED_SINCE "NOT EXISTS (SELECT 1 FROM recipes WHERE id = $1 AND version = $2)"
+
+// Двоичный формат результата для PQsendQueryPrepared (0 — текстовый)
+const int BINARY_FORMAT = 1;
+
+struct PreparedStatement {
+    const char* name;
+    const char* sql;
+    int paramCount;
+    Oid paramTypes[MAX_STATEMENT_PARAMS];
+};
+
+// Каталог запросов: каждый готовится один раз на соединение
+const PreparedStatement preparedStatements[] = {
+    // Рецепт вместе с версией. Дочерним запросам $2 передает версию из кэша:
+    // если она не изменилась, они ничего не возвращают (0 — в кэше рецепта нет)
+    {"get_recipe_by_id",
+     "SELECT name, description, cooking_time, difficulty, category, version "
+     "FROM recipes WHERE id = $1;",
+     1, {INT4_OID}},
+    
+    {"get_all_recipes",
+     "SELECT id, name, description, cooking_time, difficulty, category "
+     "FROM recipes ORDER BY name;",
+     0, {}},
+    
+    // Для построчной выдачи: теги каждого рецепта приходят в той же строке
+    {"stream_recipes",
+     "SELECT r.id, r.name, r.description, r.cooking_time, r.difficulty, r.category, "
+     "ARRAY(SELECT t.name FROM recipe_tags rt JOIN tags t ON t.id = rt.tag_id "
+     "WHERE rt.recipe_id = r.id ORDER BY t.name) "
+     "FROM recipes r ORDER BY r.name;",
+     0, {}},
+    
+    {"get_recipe_ingredients",
+     "SELECT name, quantity, unit FROM recipe_ingredients "
+     "WHERE recipe_id = $1 AND " RECIPE_CHANGED_SINCE " ORDER BY sort_order;",
+     2, {INT4_OID, INT4_OID}},
+    
+    {"get_recipe_steps",
+     "SELECT step_number, description FROM cooking_steps "
+     "WHERE recipe_id = $1 AND " RECIPE_CHANGED_SINCE " ORDER BY sort_order;",
+     2, {INT4_OID, INT4_OID}},
+    
+    {"get_recipe_tags",
+     "SELECT t.name FROM tags t "
+     "JOIN recipe_tags rt ON t.id = rt.tag_id "
+     "WHERE rt.recipe_id = $1 AND " RECIPE_CHANGED_SINCE " ORDER BY t.name;",
+     2, {INT4_OID, INT4_OID}},
+    
+    // Дочерние таблицы целиком, упорядочены по recipe_id для склейки в памяти
+    {"get_all_ingredients",
+     "SELECT recipe_id, name, quantity, unit FROM recipe_ingredients "
+     "ORDER BY recipe_id, sort_order;",
+     0, {}},
+    
+    {"get_all_steps",
+     "SELECT recipe_id, step_number, description FROM cooking_steps "
+     "ORDER BY recipe_id, sort_order;",
+     0, {}},
+    
+    // Теги одной строкой на рецепт: массив раскладывается прямо из двоичного формата
+    {"get_all_recipe_tags",
+     "SELECT rt.recipe_id, array_agg(t.name ORDER BY t.name) FROM recipe_tags rt "
+     "JOIN tags t ON t.id = rt.tag_id "
+     "GROUP BY rt.recipe_id ORDER BY rt.recipe_id;",
+     0, {}},
+    
+    {"get_all_tags",
+     "SELECT name, id FROM tags ORDER BY name COLLATE \"C\";",
+     0, {}},
+    
+    // Версии всех рецептов — по ним локальный снимок находит, что перечитать
+    {"get_recipe_versions",
+     "SELECT id, version FROM recipes;",
+     0, {}},
+    
+    {"next_recipe_id",
+     "SELECT nextval(pg_get_serial_sequence('recipes', 'id'));",
+     0, {}},
+    
+    {"reserve_recipe_ids",
+     "SELECT nextval(pg_get_serial_sequence('recipes', 'id')) "
+     "FROM generate_series(1, $1);",
+     1, {INT4_OID}},
+    
+    {"insert_recipe",
+     "INSERT INTO recipes (id, name, description, cooking_time, difficulty, category) "
+     "VALUES ($1, $2, $3, $4, $5, $6);",
+     6, {INT4_OID, TEXT_OID, TEXT_OID, INT4_OID, TEXT_OID, TEXT_OID}},
+    
+    {"update_recipe",
+     "UPDATE recipes SET name = $2, description = $3, cooking_time = $4, "
+     "difficulty = $5, category = $6 WHERE id = $1;",
+     6, {INT4_OID, TEXT_OID, TEXT_OID, INT4_OID, TEXT_OID, TEXT_OID}},
+    
+    {"delete_recipe",
+     "DELETE FROM recipes WHERE id = $1;",
+     1, {INT4_OID}},
+    
+    {"delete_recipe_ingredients",
+     "DELETE FROM recipe_ingredients WHERE recipe_id = $1;",
+     1, {INT4_OID}},
+    
+    {"insert_recipe_ingredient",
+     "INSERT INTO recipe_ingredients (recipe_id, name, quantity, unit, sort_order) "
+     "VALUES ($1, $2, $3, $4, $5);",
+     5, {INT4_OID, TEXT_OID, TEXT_OID, TEXT_OID, INT4_OID}},
+    
+    // Правка по разнице: дочерняя строка определяется позицией sort_order,
+    // лишние хвостовые строки удаляются одним запросом
+    {"update_recipe_ingredient",
+     "UPDATE recipe_ingredients SET name = $3, quantity = $4, unit = $5 "
+     "WHERE recipe_id = $1 AND sort_order = $2;",
+     5, {INT4_OID, INT4_OID, TEXT_OID, TEXT_OID, TEXT_OID}},
+    
+    {"delete_recipe_ingredients_from",
+     "DELETE FROM recipe_ingredients WHERE recipe_id = $1 AND sort_order >= $2;",
+     2, {INT4_OID, INT4_OID}},
+    
+    {"delete_recipe_steps",
+     "DELETE FROM cooking_steps WHERE recipe_id = $1;",
+     1, {INT4_OID}},
+    
+    {"insert_cooking_step",
+     "INSERT INTO cooking_steps (recipe_id, step_number, description, sort_order) "
+     "VALUES ($1, $2, $3, $4);",
+     4, {INT4_OID, INT4_OID, TEXT_OID, INT4_OID}},
+    
+    {"update_cooking_step",
+     "UPDATE cooking_steps SET step_number = $3, description = $4 "
+     "WHERE recipe_id = $1 AND sort_order = $2;",
+     4, {INT4_OID, INT4_OID, INT4_OID, TEXT_OID}},
+    
+    {"delete_recipe_steps_from",
+     "DELETE FROM cooking_steps WHERE recipe_id = $1 AND sort_order >= $2;",
+     2, {INT4_OID, INT4_OID}},
+    
+    {"delete_recipe_tags",
+     "DELETE FROM recipe_tags WHERE recipe_id = $1;",
+     1, {INT4_OID}},
+    
+    {"unlink_recipe_tags",
+     "DELETE FROM recipe_tags WHERE recipe_id = $1 "
+     "AND tag_id IN (SELECT id FROM tags WHERE name = ANY($2::text[]));",
+     2, {INT4_OID, TEXT_ARRAY_OID}},
+    
+    // Блокирует рецепт до конца транзакции; если его версия уже не та, от которой
+    // считалась разница, прерывает конвейер ошибкой serialization_failure
+    {"check_recipe_version",
+     "SELECT check_recipe_version($1, $2);",
+     2, {INT4_OID, INT4_OID}},
+    
+    // Поисковый вектор зависит от дочерних таблиц, поэтому пересчитывается
+    // в конце транзакции записи, когда они уже сохранены
+    // Это последний запрос каждой записи, поэтому он же увеличивает версию рецептов
+    {"refresh_recipe_search",
+     "UPDATE recipes SET search_vector = recipe_search_vector(id), version = version + 1 "
+     "WHERE id = ANY($1::int[]) RETURNING version;",
+     1, {INT4_ARRAY_OID}},
+    
+    // Новые теги создаются пачкой ($2), известные по кэшу передаются идентификаторами ($3);
+    // возвращаются идентификаторы новых тегов для кэша
+    {"link_recipe_tags",
+     "WITH new_tags AS ("
+     "INSERT INTO tags (name) SELECT DISTINCT unnest($2::text[]) "
+     "ON CONFLICT (name) DO UPDATE SET name = EXCLUDED.name "
+     "RETURNING id, name, xmax = 0 AS inserted), "
+     "links AS ("
+     "INSERT INTO recipe_tags (recipe_id, tag_id) "
+     "SELECT $1, id FROM new_tags UNION SELECT $1, unnest($3::int[]) "
+     "ON CONFLICT DO NOTHING) "
+     "SELECT id, name, inserted FROM new_tags;",
+     3, {INT4_OID, TEXT_ARRAY_OID, INT4_ARRAY_OID}},
+};
+
+// Миграции схемы по возрастанию версии; примененные записываются в schema_version.
+// Все шаги идемпотентны, чтобы базы, созданные до появления миграций,
+// спокойно проходили их с начала. Уже выпущенные миграции не меняются —
+// изменения схемы добавляются новыми записями в конец
+struct Migration {
+    int version;
+    const char* sql;
+    bool optional;      // сбой не прерывает обновление (например, нет прав на расширение)
+};
+
+const Migration migrations[] = {
+    {1,
+     "CREATE TABLE IF NOT EXISTS recipes ("
+     "id SERIAL PRIMARY KEY,"
+     "name VARCHAR(255) NOT NULL,"
+     "description TEXT,"
+     "cooking_time INTEGER DEFAULT 0,"
+     "difficulty VARCHAR(50) DEFAULT 'Средний',"
+     "category VARCHAR(100) DEFAULT 'Основное',"
+     "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP);"
+     
+     "CREATE TABLE IF NOT EXISTS recipe_ingredients ("
+     "id SERIAL PRIMARY KEY,"
+     "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
+     "name VARCHAR(255) NOT NULL,"
+     "quantity VARCHAR(100),"
+     "unit VARCHAR(50),"
+     "sort_order INTEGER DEFAULT 0);"
+     
+     "CREATE TABLE IF NOT EXISTS cooking_steps ("
+     "id SERIAL PRIMARY KEY,"
+     "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
+     "step_number INTEGER NOT NULL,"
+     "description TEXT NOT NULL,"
+     "sort_order INTEGER DEFAULT 0);"
+     
+     "CREATE TABLE IF NOT EXISTS tags ("
+     "id SERIAL PRIMARY KEY,"
+     "name VARCHAR(100) UNIQUE NOT NULL);"
+     
+     "CREATE TABLE IF NOT EXISTS recipe_tags ("
+     "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
+     "tag_id INTEGER REFERENCES tags(id) ON DELETE CASCADE,"
+     "PRIMARY KEY (recipe_id, tag_id));",
+     false},
+    
+    // Дочерние строки читаются по recipe_id в порядке sort_order; recipe_id в recipe_tags
+    // уже покрыт первичным ключом, а поиск рецептов по тегу идет через tag_id
+    {2,
+     "CREATE INDEX IF NOT EXISTS recipe_ingredients_recipe_idx "
+     "ON recipe_ingredients (recipe_id, sort_order);"
+     "CREATE INDEX IF NOT EXISTS cooking_steps_recipe_idx "
+     "ON cooking_steps (recipe_id, sort_order);"
+     "CREATE INDEX IF NOT EXISTS recipe_tags_tag_idx ON recipe_tags (tag_id);",
+     false},
+    
+    // Постраничный список: порядок (name, id), в том числе внутри категории
+    {3,
+     "CREATE INDEX IF NOT EXISTS recipes_name_id_idx ON recipes (name, id);"
+     "CREATE INDEX IF NOT EXISTS recipes_category_name_id_idx ON recipes (category, name, id);",
+     false},
+    
+    // Триграммный индекс для поиска по подстроке названия; без pg_trgm
+    // поиск работает полным просмотром таблицы
+    {4,
+     "CREATE EXTENSION IF NOT EXISTS pg_trgm;"
+     "CREATE INDEX IF NOT EXISTS recipes_name_trgm_idx "
+     "ON recipes USING gin (name gin_trgm_ops);",
+     true},
+    
+    // Полнотекстовый поиск: название (вес A), описание (B), ингредиенты (C) и шаги (D)
+    // в одном хранимом векторе с GIN-индексом
+    {5,
+     "ALTER TABLE recipes ADD COLUMN IF NOT EXISTS search_vector tsvector;"
+     
+     "CREATE OR REPLACE FUNCTION recipe_search_vector(target_id integer) RETURNS tsvector "
+     "LANGUAGE sql STABLE AS $$"
+     "SELECT setweight(to_tsvector(" SEARCH_CONFIG ", coalesce(r.name, '')), 'A') || "
+     "setweight(to_tsvector(" SEARCH_CONFIG ", coalesce(r.description, '')), 'B') || "
+     "setweight(to_tsvector(" SEARCH_CONFIG ", coalesce((SELECT string_agg(i.name, ' ') "
+     "FROM recipe_ingredients i WHERE i.recipe_id = r.id), '')), 'C') || "
+     "setweight(to_tsvector(" SEARCH_CONFIG ", coalesce((SELECT string_agg(s.description, ' ') "
+     "FROM cooking_steps s WHERE s.recipe_id = r.id), '')), 'D') "
+     "FROM recipes r WHERE r.id = target_id $$;"
+     
+     "UPDATE recipes SET search_vector = recipe_search_vector(id);"
+     "CREATE INDEX IF NOT EXISTS recipes_search_idx ON recipes USING gin (search_vector);",
+     false},
+    
+    // Уведомления для других клиентов. Изменение дочерних строк — правка рецепта;
+    // одинаковые уведомления одной транзакции сервер сливает в одно
+    {6,
+     "CREATE OR REPLACE FUNCTION notify_recipe_change() RETURNS trigger "
+     "LANGUAGE plpgsql AS $$ "
+     "DECLARE "
+     "op text := left(TG_OP, 1); "
+     "target integer; "
+     "BEGIN "
+     "IF TG_TABLE_NAME = 'recipes' THEN "
+     "target := CASE WHEN TG_OP = 'DELETE' THEN OLD.id ELSE NEW.id END; "
+     "ELSE "
+     "op := 'U'; "
+     "target := CASE WHEN TG_OP = 'DELETE' THEN OLD.recipe_id ELSE NEW.recipe_id END; "
+     "END IF; "
+     "PERFORM pg_notify('" CHANGE_CHANNEL "', op || ' ' || target); "
+     "RETURN NULL; "
+     "END $$;"
+     
+     "CREATE OR REPLACE FUNCTION notify_tag_change() RETURNS trigger "
+     "LANGUAGE plpgsql AS $$ "
+     "BEGIN "
+     "PERFORM pg_notify('" CHANGE_CHANNEL "', 'T ' || "
+     "CASE WHEN TG_OP = 'DELETE' THEN OLD.id ELSE NEW.id END); "
+     "RETURN NULL; "
+     "END $$;"
+     
+     "DROP TRIGGER IF EXISTS recipes_notify ON recipes;"
+     "CREATE TRIGGER recipes_notify AFTER INSERT OR UPDATE OR DELETE ON recipes "
+     "FOR EACH ROW EXECUTE FUNCTION notify_recipe_change();"
+     "DROP TRIGGER IF EXISTS recipe_ingredients_notify ON recipe_ingredients;"
+     "CREATE TRIGGER recipe_ingredients_notify AFTER INSERT OR UPDATE OR DELETE ON recipe_ingredients "
+     "FOR EACH ROW EXECUTE FUNCTION notify_recipe_change();"
+     "DROP TRIGGER IF EXISTS cooking_steps_notify ON cooking_steps;"
+     "CREATE TRIGGER cooking_steps_notify AFTER INSERT OR UPDATE OR DELETE ON cooking_steps "
+     "FOR EACH ROW EXECUTE FUNCTION notify_recipe_change();"
+     "DROP TRIGGER IF EXISTS recipe_tags_notify ON recipe_tags;"
+     "CREATE TRIGGER recipe_tags_notify AFTER INSERT OR UPDATE OR DELETE ON recipe_tags "
+     "FOR EACH ROW EXECUTE FUNCTION notify_recipe_change();"
+     "DROP TRIGGER IF EXISTS tags_notify ON tags;"
+     "CREATE TRIGGER tags_notify AFTER INSERT OR UPDATE OR DELETE ON tags "
+     "FOR EACH ROW EXECUTE FUNCTION notify_tag_change();",
+     false},
+    
+    // Версия строки рецепта: растет при каждой записи через приложение,
+    // по ней кэш рецептов сверяет свои записи
+    {7,
+     "ALTER TABLE recipes ADD COLUMN IF NOT EXISTS version integer NOT NULL DEFAULT 1;",
+     false},
+    
+    // Запись по разнице допустима, только пока рецепт не изменили с другого клиента
+    {8,
+     "CREATE OR REPLACE FUNCTION check_recipe_version(target integer, expected integer) RETURNS void "
+     "LANGUAGE plpgsql AS $$ "
+     "BEGIN "
+     "PERFORM 1 FROM recipes WHERE id = target AND version = expected FOR UPDATE; "
+     "IF NOT FOUND THEN "
+     "RAISE EXCEPTION 'Рецепт % изменен другим клиентом', target "
+     "USING ERRCODE = 'serialization_failure'; "
+     "END IF; "
+     "END $$;",
+     false},
+    
+    // Постраничный список упорядочен по именам побайтово (COLLATE "C"), а не по
+    // локали базы; индексы из миграции 3 заменяются индексами с тем же сравнением
+    {9,
+     "CREATE INDEX IF NOT EXISTS recipes_name_c_id_idx ON recipes (name COLLATE \"C\", id);"
+     "CREATE INDEX IF NOT EXISTS recipes_category_name_c_id_idx "
+     "ON recipes (category, name COLLATE \"C\", id);"
+     "DROP INDEX IF EXISTS recipes_name_id_idx;"
+     "DROP INDEX IF EXISTS recipes_category_name_id_idx;",
+     false},
+    
+    // link_recipe_tags делает пустой UPDATE тегу, которого нет в кэше клиента;
+    // уведомлять нужно только о появлении, удалении и переименовании тега
+    {10,
+     "DROP TRIGGER IF EXISTS tags_notify ON tags;"
+     "CREATE TRIGGER tags_notify AFTER INSERT OR DELETE ON tags "
+     "FOR EACH ROW EXECUTE FUNCTION notify_tag_change();"
+     "DROP TRIGGER IF EXISTS tags_rename_notify ON tags;"
+     "CREATE TRIGGER tags_rename_notify AFTER UPDATE ON tags "
+     "FOR EACH ROW WHEN (OLD.name IS DISTINCT FROM NEW.name) "
+     "EXECUTE FUNCTION notify_tag_change();",
+     false},
+};
+
+// SQLSTATE ошибки "таблица не существует"
+const char* const UNDEFINED_TABLE = "42P01";
+// SQLSTATE конфликта версий из check_recipe_version
+const char* const SERIALIZATION_FAILURE = "40001";
+
+bool hasSqlState(const PGresults& results, const char* state) {
+    for (const auto& res : results) {
+        const char* code = PQresultErrorField(res.get(), PG_DIAG_SQLSTATE);
+        if (code && strcmp(code, state) == 0) return true;
+    }
+    return false;
+}
+
+// Параметры insert_recipe и update_recipe
+vector<string> recipeRowParams(const string& id, const Recipe& recipe) {
+    return {
+        id,
+        recipe.getName(),
+        recipe.getDescription(),
+        to_string(recipe.getCookingTime()),
+        recipe.getDifficulty(),
+        recipe.getCategory()
+    };
+}
+
+bool sameRecipeRow(const Recipe& a, const Recipe& b) {
+    return a.getName() == b.getName() && a.getDescription() == b.getDescription() &&
+           a.getCookingTime() == b.getCookingTime() && a.getDifficulty() == b.getDifficulty() &&
+           a.getCategory() == b.getCategory();
+}
+
+// Теги в том порядке, в каком их вернет чтение из базы
+vector<string> sortedTags(vector<string> tags) {
+    sort(tags.begin(), tags.end());
+    tags.erase(unique(tags.begin(), tags.end()), tags.end());
+    return tags;
+}
+
+// Буфер COPY отправляется серверу порциями такого размера
+const size_t COPY_CHUNK_SIZE = 64 * 1024;
+
+// Поле в текстовом формате COPY: спецсимволы экранируются обратной косой чертой
+void appendCopyField(string& buffer, const string& value, char delimiter = '\t') {
+    for (char c : value) {
+        switch (c) {
+        case '\\': buffer += "\\\\"; break;
+        case '\t': buffer += "\\t"; break;
+        case '\n': buffer += "\\n"; break;
+        case '\r': buffer += "\\r"; break;
+        default: buffer += c;
+        }
+    }
+    buffer += delimiter;
+}
+
+void appendCopyField(string& buffer, long long value, char delimiter = '\t') {
+    buffer += to_string(value);
+    buffer += delimiter;
+}
+
+// Литерал массива PostgreSQL: {"a","b"} с экранированием кавычек и обратной косой черты
+string toArrayLiteral(const vector<string>& values) {
+    string literal = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) literal += ',';
+        literal += '"';
+        for (char c : values[i]) {
+            if (c == '"' || c == '\\') literal += '\\';
+            literal += c;
+        }
+        literal += '"';
+    }
+    literal += '}';
+    return literal;
+}
+
+string toArrayLiteral(const vector<int>& values) {
+    string literal = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) literal += ',';
+        literal += to_string(values[i]);
+    }
+    literal += '}';
+    return literal;
+}
+
+// Подстрока для LIKE: символы шаблона экранируются обратной косой чертой
+string escapeLikePattern(const string& text) {
+    string pattern;
+    pattern.reserve(text.size() + 2);
+    for (char c : text) {
+        if (c == '%' || c == '_' || c == '\\') pattern += '\\';
+        pattern += c;
+    }
+    return pattern;
+}
+
+// Условие "у рецепта r есть все теги"; литерал массива добавляется в params
+string allTagsCondition(vector<string> tags, vector<string>& params) {
+    sort(tags.begin(), tags.end());
+    tags.erase(unique(tags.begin(), tags.end()), tags.end());
+    params.push_back(toArrayLiteral(tags));
+    
+    return "r.id IN (SELECT rt.recipe_id FROM recipe_tags rt JOIN tags t ON t.id = rt.tag_id "
+           "WHERE t.name = ANY($" + to_string(params.size()) + "::text[]) "
+           "GROUP BY rt.recipe_id HAVING count(*) = " + to_string(tags.size()) + ")";
+}
+
+// Условие "у рецепта r есть хотя бы один из тегов"; литерал массива добавляется в params
+string anyTagCondition(const vector<string>& tags, vector<string>& params) {
+    params.push_back(toArrayLiteral(tags));
+    
+    return "EXISTS (SELECT 1 FROM recipe_tags rt JOIN tags t ON t.id = rt.tag_id "
+           "WHERE rt.recipe_id = r.id AND t.name = ANY($" + to_string(params.size()) + "::text[]))";
+}
+
+// Запрос страницы списка: в SQL попадают только заданные условия, чтобы
+// планировщик видел конкретные значения и выбирал подходящий индекс.
+// Колонки совпадают с stream_recipes
+struct RecipeQuery {
+    string sql;
+    vector<string> params;
+};
+
+RecipeQuery buildRecipeQuery(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) {
+    RecipeQuery query;
+    query.sql = "SELECT r.id, r.name, r.description, r.cooking_time, r.difficulty, r.category, "
+                "ARRAY(SELECT t.name FROM recipe_tags rt JOIN tags t ON t.id = rt.tag_id "
+                "WHERE rt.recipe_id = r.id ORDER BY t.name) "
+                "FROM recipes r";
+    
+    bool first = true;
+    auto where = [&](const string& condition) {
+        query.sql += first ? " WHERE " : " AND ";
+        query.sql += condition;
+        first = false;
+    };
+    auto param = [&](string value) {
+        query.params.push_back(move(value));
+        return "$" + to_string(query.params.size());
+    };
+    
+    // Подстрока ищется через ILIKE — его ускоряет GIN-индекс pg_trgm
+    if (!filter.nameContains.empty()) {
+        where("r.name ILIKE " + param("%" + escapeLikePattern(filter.nameContains) + "%"));
+    }
+    
+    // Рецепт должен иметь все выбранные теги
+    if (!filter.tags.empty()) {
+        where(allTagsCondition(filter.tags, query.params));
+    }
+    if (!filter.anyTags.empty()) {
+        where(anyTagCondition(filter.anyTags, query.params));
+    }
+    
+    if (!filter.category.empty()) {
+        where("r.category = " + param(filter.category));
+    }
+    if (!filter.difficulty.empty()) {
+        where("r.difficulty = " + param(filter.difficulty));
+    }
+    if (filter.minCookingTime > 0) {
+        where("r.cooking_time >= " + param(to_string(filter.minCookingTime)));
+    }
+    if (filter.maxCookingTime > 0) {
+        where("r.cooking_time <= " + param(to_string(filter.maxCookingTime)));
+    }
+    
+    // Keyset: продолжаем с ключа последней строки предыдущей страницы,
+    // поэтому цена запроса не зависит от номера страницы
+    if (afterKey.id > 0) {
+        string name = param(afterKey.name);
+        where("(r.name COLLATE \"C\", r.id) > (" + name + ", " + param(to_string(afterKey.id)) + ")");
+    }
+    
+    // Имена сравниваются побайтово при любой локали базы: модель списка
+    // ищет строки по ключу (name, id) тем же сравнением
+    query.sql += " ORDER BY r.name COLLATE \"C\", r.id LIMIT " + to_string(max(limit, 1)) + ";";
+    return query;
+}
+
+// Запрос к поисковому вектору: каждое слово ищется как префикс, чтобы
+// результаты появлялись уже во время набора. Из слов оставляются только буквы
+// и цифры (байты UTF-8 считаются буквами), поэтому синтаксис tsquery не нарушается
+string toPrefixTsQuery(const string& text) {
+    string query;
+    string word;
+    
+    auto flush = [&]() {
+        if (word.empty()) return;
+        if (!query.empty()) query += " & ";
+        query += word + ":*";
+        word.clear();
+    };
+    
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte >= 0x80 || isalnum(byte)) {
+            word += c;
+        } else {
+            flush();
+        }
+    }
+    flush();
+    
+    return query;
+}
+
+// Поиск: ранжирование по всем совпадениям, сниппеты только для лучших limit строк.
+// Колонки: id, name, rank, snippet, tags
+RecipeQuery buildSearchQuery(const string& tsQuery, const vector<string>& tags, int limit, const vector<int>& within) {
+    RecipeQuery query;
+    query.params.push_back(tsQuery);
+    
+    string tagFilter;
+    if (!tags.empty()) {
+        tagFilter = " AND " + allTagsCondition(tags, query.params);
+    }
+    
+    // Сужение: запрос проверяется только на рецептах прошлой выдачи по первичному ключу
+    if (!within.empty()) {
+        query.params.push_back(toArrayLiteral(within));
+        tagFilter += " AND r.id = ANY($" + to_string(query.params.size()) + "::int[])";
+    }
+    
+    query.sql = "SELECT top.id, top.name, top.rank, "
+                "ts_headline(" SEARCH_CONFIG ", concat_ws(' ', top.description, "
+                "(SELECT string_agg(i.name, ', ' ORDER BY i.sort_order) FROM recipe_ingredients i "
+                "WHERE i.recipe_id = top.id), "
+                "(SELECT string_agg(s.description, ' ' ORDER BY s.sort_order) FROM cooking_steps s "
+                "WHERE s.recipe_id = top.id)), top.query, "
+                "'StartSel=<b>, StopSel=</b>, MaxFragments=2, MinWords=5, MaxWords=15, "
+                "FragmentDelimiter=\" … \"'), "
+                "ARRAY(SELECT t.name FROM recipe_tags rt JOIN tags t ON t.id = rt.tag_id "
+                "WHERE rt.recipe_id = top.id ORDER BY t.name) "
+                "FROM (SELECT r.id, r.name, r.description, q.query, "
+                "ts_rank(r.search_vector, q.query)::float4 AS rank "
+                "FROM recipes r, to_tsquery(" SEARCH_CONFIG ", $1) AS q(query) "
+                "WHERE r.search_vector @@ q.query" + tagFilter + " "
+                "ORDER BY rank DESC, r.id LIMIT " + to_string(max(limit, 1)) + ") top "
+                "ORDER BY top.rank DESC, top.id;";
+    return query;
+}
+
+// Чтение колонок двоичного результата: целые в сетевом порядке байт,
+// текст без завершающего нуля (длина из PQgetlength)
+int32_t readInt32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return static_cast<int32_t>(ntohl(value));
+}
+
+int readInt(const PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) return 0;
+    return readInt32(PQgetvalue(res, row, column));
+}
+
+float readFloat(const PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) return 0;
+    
+    uint32_t bits = static_cast<uint32_t>(readInt32(PQgetvalue(res, row, column)));
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+string readText(const PGresult* res, int row, int column) {
+    return string(PQgetvalue(res, row, column), PQgetlength(res, row, column));
+}
+
+// Одномерный массив text/varchar: заголовок (ndim, флаг NULL, OID элемента,
+// размер и нижняя граница), затем элементы как длина + байты
+vector<string> readTextArray(const PGresult* res, int row, int column) {
+    vector<string> values;
+    if (PQgetisnull(res, row, column)) return values;
+    
+    const char* data = PQgetvalue(res, row, column);
+    const char* end = data + PQgetlength(res, row, column);
+    
+    int dimensions = readInt32(data);
+    if (dimensions != 1) return values;
+    
+    int count = readInt32(data + 12);
+    data += 20;
+    values.reserve(count);
+    
+    for (int i = 0; i < count && data + 4 <= end; ++i) {
+        int length = readInt32(data);
+        data += 4;
+        if (length < 0) {
+            values.emplace_back();
+            continue;
+        }
+        values.emplace_back(data, length);
+        data += length;
+    }
+    
+    return values;
+}
+
+// Основные поля рецепта: id, name, description, cooking_time, difficulty, category
+Recipe readRecipeSummary(const PGresult* res, int row) {
+    Recipe recipe(readText(res, row, 1), readText(res, row, 2));
+    recipe.setId(readInt(res, row, 0));
+    recipe.setCookingTime(readInt(res, row, 3));
+    recipe.setDifficulty(readText(res, row, 4));
+    recipe.setCategory(readText(res, row, 5));
+    return recipe;
+}
+
+// Разбор результатов дочерних запросов (колонки как в каталоге выше)
+void readIngredients(Recipe& recipe, const PGresult* res) {
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i) {
+        recipe.addIngredient(Ingredient(
+            readText(res, i, 0),
+            readText(res, i, 1),
+            readText(res, i, 2)
+        ));
+    }
+}
+
+void readSteps(Recipe& recipe, const PGresult* res) {
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i) {
+        recipe.addStep(CookingStep(
+            readInt(res, i, 0),
+            readText(res, i, 1)
+        ));
+    }
+}
+
+void readTags(Recipe& recipe, const PGresult* res) {
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; ++i) {
+        recipe.addTag(readText(res, i, 0));
+    }
+}
+
+// Раскладывает строки дочернего запроса (колонка 0 — recipe_id) по рецептам.
+// Строки отсортированы по recipe_id, поэтому поиск в словаре идет раз на рецепт.
+template <typename AddRow>
+void stitchRows(const PGresult* res, const unordered_map<int, Recipe*>& byId, AddRow addRow) {
+    int rows = PQntuples(res);
+    int currentId = -1;
+    Recipe* current = nullptr;
+    
+    for (int i = 0; i < rows; ++i) {
+        int id = readInt(res, i, 0);
+        if (id != currentId) {
+            auto it = byId.find(id);
+            current = it != byId.end() ? it->second : nullptr;
+            currentId = id;
+        }
+        
+        if (current) {
+            addRow(*current, i);
+        }
+    }
+}
+
+}
+
+CookBookDatabase::CookBookDatabase() : conn_(nullptr), pipelineQueued_(0), listening_(false) {}
 
 CookBookDatabase::~CookBookDatabase() {
     disconnect();
 }
 
-bool CookBookDatabase::connect() {
-    cout << "Подключение к PostgreSQL..." << endl;
+const char* CookBookDatabase::connectionInfo() {
+    // Без connect_timeout недоступный сервер держал бы подключение минутами
+    return "host=localhost dbname=cookbook user=cookbookuser password=cookbook123 connect_timeout=5";
+}
+
+bool CookBookDatabase::connect() {
+    cout << "Подключение к PostgreSQL..." << endl;
+    
+    conn_ = PQconnectdb(connectionInfo());
+    
+    if (PQstatus(conn_) != CONNECTION_OK) {
+        lastError_ = PQerrorMessage(conn_);
+        cout << "Ошибка: " << lastError_ << endl;
+        disconnect();
+        return false;
+    }
+    
+    cout << "Подключение успешно!" << endl;
+    if (!migrateSchema() || !prepareStatements()) return false;
+    
+    if (cache_) {
+        cache_->addOwnBackend(backendPid());
+    }
+    return true;
+}
+
+void CookBookDatabase::disconnect() {
+    if (listening_) {
+        setListening(false);
+    }
+    
+    if (conn_) {
+        if (cache_) {
+            cache_->removeOwnBackend(backendPid());
+        }
+        PQfinish(conn_);
+        conn_ = nullptr;
+    }
+    
+    forgetTagIds();
+}
+
+bool CookBookDatabase::isHealthy() const {
+    return conn_ && PQstatus(conn_) == CONNECTION_OK &&
+           PQtransactionStatus(conn_) == PQTRANS_IDLE;
+}
+
+int CookBookDatabase::backendPid() const {
+    return conn_ ? PQbackendPID(conn_) : 0;
+}
+
+void CookBookDatabase::setRecipeCache(shared_ptr<RecipeCache> cache) {
+    if (cache_ && conn_) {
+        cache_->removeOwnBackend(backendPid());
+    }
+    
+    cache_ = move(cache);
+    if (cache_ && conn_) {
+        cache_->addOwnBackend(backendPid());
+    }
+}
+
+bool CookBookDatabase::ping() {
+    if (!conn_) return false;
+    
+    // Пустой запрос — самый дешевый способ убедиться, что сервер отвечает
+    PGresultPtr res(PQexec(conn_, ""));
+    if (PQresultStatus(res.get()) != PGRES_EMPTY_QUERY) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
+    }
+    
+    return true;
+}
+
+bool CookBookDatabase::migrateSchema() {
+    if (!conn_) {
+        lastError_ = "Нет подключения к БД";
+        return false;
+    }
+    
+    // Обычный запуск — один запрос: все миграции уже применены. Пропущенная
+    // необязательная миграция не записывается и пробуется при каждом запуске
+    unordered_set<int> applied;
+    if (!appliedMigrations(applied)) return false;
+    
+    auto pending = [&applied](const Migration& migration) { return applied.count(migration.version) == 0; };
+    if (none_of(begin(migrations), end(migrations), pending)) return true;
+    
+    cout << "Обновление схемы БД..." << endl;
+    
+    if (!executeQuery("BEGIN")) return false;
+    
+    // Блокировка не дает двум клиентам накатывать миграции одновременно;
+    // примененные миграции перечитываем уже под ней
+    bool success = executeQuery("CREATE TABLE IF NOT EXISTS schema_version ("
+                                "version INTEGER PRIMARY KEY,"
+                                "applied_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP);") &&
+                   executeQuery("LOCK TABLE schema_version IN EXCLUSIVE MODE;");
+    
+    success = success && appliedMigrations(applied);
+    
+    for (const auto& migration : migrations) {
+        if (!success) break;
+        if (!pending(migration)) continue;
+        
+        bool done = true;
+        if (migration.optional) {
+            // Сбой необязательного шага откатывается до точки сохранения,
+            // а версия не записывается — шаг повторится при следующем запуске
+            success = executeQuery("SAVEPOINT optional_migration;");
+            done = success && executeQuery(migration.sql);
+            if (success && !done) {
+                cout << "Миграция " << migration.version << " пропущена: " << lastError_ << endl;
+                success = executeQuery("ROLLBACK TO SAVEPOINT optional_migration;");
+            }
+        } else {
+            success = executeQuery(migration.sql);
+        }
+        
+        success = success && (!done || executeQuery("INSERT INTO schema_version (version) VALUES (" +
+                                                    to_string(migration.version) + ");"));
+    }
+    
+    if (!success || !executeQuery("COMMIT")) {
+        string error = lastError_;
+        executeQuery("ROLLBACK");
+        lastError_ = error;
+        cout << "Ошибка миграции схемы: " << lastError_ << endl;
+        return false;
+    }
+    
+    return true;
+}
+
+bool CookBookDatabase::appliedMigrations(unordered_set<int>& versions) {
+    versions.clear();
+    PGresultPtr res(PQexec(conn_, "SELECT version FROM schema_version;"));
+    
+    if (PQresultStatus(res.get()) == PGRES_TUPLES_OK) {
+        for (int i = 0; i < PQntuples(res.get()); ++i) {
+            versions.insert(atoi(PQgetvalue(res.get(), i, 0)));
+        }
+        return true;
+    }
+    
+    // Таблицы версий еще нет — база пустая или создана до появления миграций
+    const char* state = PQresultErrorField(res.get(), PG_DIAG_SQLSTATE);
+    if (state && strcmp(state, UNDEFINED_TABLE) == 0) {
+        return true;
+    }
+    
+    lastError_ = PQerrorMessage(conn_);
+    return false;
+}
+
+bool CookBookDatabase::prepareStatements() {
+    // Весь каталог готовится одним конвейером
+    if (!beginPipeline()) return false;
+    
+    bool queued = queuePrepareStatements();
+    
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        cout << "Ошибка подготовки запросов: " << lastError_ << endl;
+        return false;
+    }
+    
+    return true;
+}
+
+bool CookBookDatabase::queuePrepareStatements() {
+    // Подготовленные запросы живут до закрытия соединения
+    for (const auto& statement : preparedStatements) {
+        if (PQsendPrepare(conn_, statement.name, statement.sql,
+                          statement.paramCount, statement.paramTypes) != 1) {
+            lastError_ = PQerrorMessage(conn_);
+            return false;
+        }
+        
+        ++pipelineQueued_;
+    }
+    
+    return true;
+}
+
+bool CookBookDatabase::queueListen() {
+    return sendQuery("LISTEN " CHANGE_CHANNEL ";");
+}
+
+void CookBookDatabase::setListening(bool listening) {
+    listening_ = listening;
+    if (cache_) {
+        cache_->setTracking(listening);
+    }
+}
+
+vector<ChangeNotification> CookBookDatabase::takeNotifications() {
+    vector<ChangeNotification> notifications;
+    if (!conn_) return notifications;
+    
+    // PQnotifies отдает только уже прочитанное из сокета (после PQconsumeInput)
+    while (PGnotify* notify = PQnotifies(conn_)) {
+        const char* payload = notify->extra;
+        
+        ChangeNotification notification;
+        notification.senderPid = notify->be_pid;
+        notification.id = payload[0] ? atoi(payload + 1) : 0;
+        switch (payload[0]) {
+        case 'D': notification.kind = ChangeNotification::RecipeRemoved; break;
+        case 'T': notification.kind = ChangeNotification::TagsChanged; break;
+        default: notification.kind = ChangeNotification::RecipeChanged; break;
+        }
+        notifications.push_back(notification);
+        
+        if (cache_) {
+            if (notification.kind == ChangeNotification::TagsChanged) {
+                // Переименованный тег меняет все рецепты с ним
+                cache_->invalidateAll(notification.senderPid);
+            } else {
+                cache_->invalidate(notification.id, notification.senderPid);
+            }
+        }
+        
+        PQfreemem(notify);
+    }
+    
+    return notifications;
+}
+
+bool CookBookDatabase::executeQuery(const string& query) {
+    if (!conn_) {
+        lastError_ = "Нет подключения к БД";
+        return false;
+    }
+    
+    PGresult* res = PQexec(conn_, query.c_str());
+    ExecStatusType status = PQresultStatus(res);
+    bool success = (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK);
+    
+    if (!success) {
+        lastError_ = PQerrorMessage(conn_);
+    }
+    
+    PQclear(res);
+    return success;
+}
+
+PGresultPtr CookBookDatabase::execPrepared(const char* name, const vector<string>& params) {
+    vector<const char*> values;
+    values.reserve(params.size());
+    for (const auto& param : params) {
+        values.push_back(param.c_str());
+    }
+    
+    PGresultPtr res(PQexecPrepared(conn_, name, static_cast<int>(values.size()),
+                                   values.data(), nullptr, nullptr, 0));
+    
+    ExecStatusType status = PQresultStatus(res.get());
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        lastError_ = PQerrorMessage(conn_);
+    }
+    
+    return res;
+}
+
+bool CookBookDatabase::executePrepared(const char* name, const vector<string>& params) {
+    if (!conn_) {
+        lastError_ = "Нет подключения к БД";
+        return false;
+    }
+    
+    PGresultPtr res = execPrepared(name, params);
+    ExecStatusType status = PQresultStatus(res.get());
+    return status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK;
+}
+
+bool CookBookDatabase::beginPipeline() {
+    if (!conn_) {
+        lastError_ = "Нет подключения к БД";
+        return false;
+    }
+    
+    if (PQenterPipelineMode(conn_) != 1) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
+    }
+    
+    pipelineQueued_ = 0;
+    tagResultSlots_.clear();
+    return true;
+}
+
+bool CookBookDatabase::sendPrepared(const char* name, const vector<string>& params, int resultFormat) {
+    vector<const char*> values;
+    values.reserve(params.size());
+    for (const auto& param : params) {
+        values.push_back(param.c_str());
+    }
+    
+    if (PQsendQueryPrepared(conn_, name, static_cast<int>(values.size()),
+                            values.data(), nullptr, nullptr, resultFormat) != 1) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
+    }
+    
+    ++pipelineQueued_;
+    return true;
+}
+
+bool CookBookDatabase::sendQuery(const char* sql, const vector<string>& params, int resultFormat) {
+    vector<const char*> values;
+    values.reserve(params.size());
+    for (const auto& param : params) {
+        values.push_back(param.c_str());
+    }
+    
+    // В режиме конвейера допустим только расширенный протокол
+    if (PQsendQueryParams(conn_, sql, static_cast<int>(values.size()), nullptr,
+                          values.data(), nullptr, nullptr, resultFormat) != 1) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
+    }
+    
+    ++pipelineQueued_;
+    return true;
+}
+
+bool CookBookDatabase::syncPipeline(PGresults& results) {
+    bool success = true;
+    bool synced = PQpipelineSync(conn_) == 1;
+    
+    if (!synced) {
+        lastError_ = PQerrorMessage(conn_);
+        success = false;
+    }
+    
+    // На каждый запрос приходит результат и завершающий NULL
+    for (int i = 0; synced && i < pipelineQueued_; ++i) {
+        PGresultPtr res(PQgetResult(conn_));
+        if (!res) {
+            lastError_ = PQerrorMessage(conn_);
+            success = synced = false;
+            break;
+        }
+        
+        ExecStatusType status = PQresultStatus(res.get());
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+            // После первой ошибки остальные запросы приходят как PGRES_PIPELINE_ABORTED
+            if (status != PGRES_PIPELINE_ABORTED) {
+                lastError_ = PQresultErrorMessage(res.get());
+            }
+            success = false;
+        }
+        
+        results.push_back(move(res));
+        
+        while (PGresult* extra = PQgetResult(conn_)) {
+            PQclear(extra);
+        }
+    }
+    
+    // Точка синхронизации: после нее соединение готово к новым запросам
+    if (synced) {
+        PGresultPtr res(PQgetResult(conn_));
+        if (PQresultStatus(res.get()) != PGRES_PIPELINE_SYNC) {
+            lastError_ = PQerrorMessage(conn_);
+            success = false;
+        }
+    }
+    
+    PQexitPipelineMode(conn_);
+    pipelineQueued_ = 0;
+    return success;
+}
+
+void CookBookDatabase::rollbackTransaction() {
+    if (PQtransactionStatus(conn_) != PQTRANS_IDLE) {
+        string error = lastError_;
+        executeQuery("ROLLBACK");
+        lastError_ = error;
+    }
+}
+
+bool CookBookDatabase::writeRecipe(const Recipe& recipe, int recipeId, bool isNew, RecipeChange* change) {
+    string id = to_string(recipeId);
+    
+    // Вся запись одной транзакцией в одном конвейере
+    if (!beginPipeline()) return false;
+    
+    bool queued = sendQuery("BEGIN") &&
+                  sendPrepared(isNew ? "insert_recipe" : "update_recipe", recipeRowParams(id, recipe)) &&
+                  saveRecipeIngredients(recipeId, recipe.getIngredients()) &&
+                  saveRecipeSteps(recipeId, recipe.getSteps()) &&
+                  saveRecipeTags(recipeId, recipe.getTags()) &&
+                  sendPrepared("refresh_recipe_search", {"{" + id + "}"}) &&
+                  sendQuery("COMMIT");
+    
+    PGresults results;
+    bool success = syncPipeline(results) && queued;
+    
+    if (!success) {
+        rollbackTransaction();
+        forgetTagIds();
+        return false;
+    }
+    
+    finishRecipeWrite(recipe, recipeId, isNew, results, change);
+    return true;
+}
+
+bool CookBookDatabase::writeRecipeChanges(const Recipe& recipe, const Recipe& stored, int storedVersion,
+                                          RecipeChange* change, bool* conflict) {
+    int recipeId = recipe.getId();
+    string id = to_string(recipeId);
+    *conflict = false;
+    
+    if (!beginPipeline()) return false;
+    
+    // Пишутся только отличия от stored; проверка версии первой в транзакции
+    // гарантирует, что stored — то, что сейчас лежит в базе
+    bool queued = sendQuery("BEGIN") &&
+                  sendPrepared("check_recipe_version", {id, to_string(storedVersion)}) &&
+                  (sameRecipeRow(recipe, stored) || sendPrepared("update_recipe", recipeRowParams(id, recipe))) &&
+                  saveChangedIngredients(recipeId, recipe.getIngredients(), stored.getIngredients()) &&
+                  saveChangedSteps(recipeId, recipe.getSteps(), stored.getSteps()) &&
+                  saveChangedTags(recipeId, recipe.getTags(), stored.getTags()) &&
+                  sendPrepared("refresh_recipe_search", {"{" + id + "}"}) &&
+                  sendQuery("COMMIT");
+    
+    PGresults results;
+    bool success = syncPipeline(results) && queued;
+    
+    if (!success) {
+        *conflict = hasSqlState(results, SERIALIZATION_FAILURE);
+        rollbackTransaction();
+        forgetTagIds();
+        return false;
+    }
+    
+    finishRecipeWrite(recipe, recipeId, false, results, change);
+    return true;
+}
+
+void CookBookDatabase::finishRecipeWrite(const Recipe& recipe, int recipeId, bool isNew,
+                                         const PGresults& results, RecipeChange* change) {
+    vector<string> tags = sortedTags(recipe.getTags());
+    
+    // Версию вернул пересчет поискового вектора — последний запрос перед COMMIT
+    const PGresult* refreshed = results[results.size() - 2].get();
+    if (cache_ && PQntuples(refreshed) == 1) {
+        Recipe stored = recipe;
+        stored.setId(recipeId);
+        stored.clearTags();
+        for (const auto& tag : tags) {
+            stored.addTag(tag);
+        }
+        cache_->put(stored, atoi(PQgetvalue(refreshed, 0, 0)));
+    }
+    
+    if (!change) {
+        rememberTagIds(results);
+        return;
+    }
+    
+    change->kind = isNew ? RecipeChange::Inserted : RecipeChange::Updated;
+    change->id = recipeId;
+    change->name = recipe.getName();
+    change->tags = move(tags);
+    change->createdTags.clear();
+    rememberTagIds(results, &change->createdTags);
+}
+
+int CookBookDatabase::addRecipe(Recipe& recipe, RecipeChange* change) {
+    if (!conn_) return -1;
+    
+    // Идентификатор берем заранее, чтобы дочерние строки ушли в том же конвейере
+    PGresultPtr res = execPrepared("next_recipe_id", {});
+    
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+        return -1;
+    }
+    
+    int recipeId = atoi(PQgetvalue(res.get(), 0, 0));
+    
+    if (!writeRecipe(recipe, recipeId, true, change)) {
+        return -1;
+    }
+    
+    recipe.setId(recipeId);
+    return recipeId;
+}
+
+bool CookBookDatabase::addRecipes(vector<Recipe>& recipes) {
+    if (!conn_) return false;
+    if (recipes.empty()) return true;
+    
+    if (!executeQuery("BEGIN")) return false;
+    
+    // Резервируем идентификаторы для всей пачки одним запросом
+    vector<int> ids;
+    {
+        PGresultPtr res = execPrepared("reserve_recipe_ids", {to_string(recipes.size())});
+        if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
+            rollbackTransaction();
+            return false;
+        }
+        
+        int rows = PQntuples(res.get());
+        ids.reserve(rows);
+        for (int i = 0; i < rows; ++i) {
+            ids.push_back(atoi(PQgetvalue(res.get(), i, 0)));
+        }
+    }
+    
+    vector<int> previousIds;
+    previousIds.reserve(recipes.size());
+    for (size_t i = 0; i < recipes.size(); ++i) {
+        previousIds.push_back(recipes[i].getId());
+        recipes[i].setId(ids[i]);
+    }
+    
+    // Рецепты и дочерние строки потоком COPY, теги конвейером
+    bool success = copyRecipes(recipes) &&
+                   copyRecipeIngredients(recipes) &&
+                   copyRecipeSteps(recipes) &&
+                   beginPipeline();
+    
+    if (success) {
+        bool queued = true;
+        for (const auto& recipe : recipes) {
+            queued = queued && saveRecipeTags(recipe.getId(), recipe.getTags());
+        }
+        queued = queued && sendPrepared("refresh_recipe_search", {toArrayLiteral(ids)}) &&
+                 sendQuery("COMMIT");
+        
+        PGresults results;
+        success = syncPipeline(results) && queued;
+        
+        if (success) {
+            rememberTagIds(results);
+        }
+    }
+    
+    if (!success) {
+        rollbackTransaction();
+        forgetTagIds();
+        for (size_t i = 0; i < recipes.size(); ++i) {
+            recipes[i].setId(previousIds[i]);
+        }
+    }
+    
+    return success;
+}
+
+shared_ptr<Recipe> CookBookDatabase::getRecipeById(int id) {
+    return loadRecipe(id, nullptr);
+}
+
+shared_ptr<Recipe> CookBookDatabase::loadRecipe(int id, int* version) {
+    // Запись кэша, которой можно верить, отдается без обращения к серверу
+    int knownVersion = 0;
+    shared_ptr<Recipe> cached = cachedRecipe(id, &knownVersion, version);
+    if (cached && knownVersion == 0) {
+        return cached;
+    }
+    
+    if (!conn_) return nullptr;
+    
+    // Рецепт и все дочерние таблицы одним конвейером
+    if (!beginPipeline()) return nullptr;
+    
+    bool queued = queueRecipeById(id, knownVersion);
+    
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        return nullptr;
+    }
+    
+    return readRecipeById(id, results, cached, knownVersion, version);
+}
+
+shared_ptr<Recipe> CookBookDatabase::cachedRecipe(int id, int* checkVersion, int* version) {
+    *checkVersion = 0;
+    return cache_ ? cache_->find(id, checkVersion, version) : nullptr;
+}
+
+bool CookBookDatabase::queueRecipeById(int id, int knownVersion) {
+    string recipeId = to_string(id);
+    string version = to_string(knownVersion);
+    
+    return sendPrepared("get_recipe_by_id", {recipeId}, BINARY_FORMAT) &&
+           sendPrepared("get_recipe_ingredients", {recipeId, version}, BINARY_FORMAT) &&
+           sendPrepared("get_recipe_steps", {recipeId, version}, BINARY_FORMAT) &&
+           sendPrepared("get_recipe_tags", {recipeId, version}, BINARY_FORMAT);
+}
+
+shared_ptr<Recipe> CookBookDatabase::readRecipeById(int id, const PGresults& results,
+                                                    shared_ptr<Recipe> cached, int knownVersion, int* version) {
+    const PGresult* recipeRes = results[0].get();
+    if (PQntuples(recipeRes) == 0) {
+        if (cache_) {
+            cache_->erase(id);
+        }
+        return nullptr;
+    }
+    
+    // Версия не изменилась: дочерние запросы пусты, рецепт из кэша все еще верен
+    int storedVersion = readInt(recipeRes, 0, 5);
+    if (version) {
+        *version = storedVersion;
+    }
+    if (cached && storedVersion == knownVersion) {
+        cache_->put(*cached, storedVersion);
+        return cached;
+    }
+    
+    auto recipe = make_shared<Recipe>(
+        readText(recipeRes, 0, 0),
+        readText(recipeRes, 0, 1)
+    );
+    
+    recipe->setId(id);
+    recipe->setCookingTime(readInt(recipeRes, 0, 2));
+    recipe->setDifficulty(readText(recipeRes, 0, 3));
+    recipe->setCategory(readText(recipeRes, 0, 4));
+    
+    readIngredients(*recipe, results[1].get());
+    readSteps(*recipe, results[2].get());
+    readTags(*recipe, results[3].get());
+    
+    if (cache_) {
+        cache_->put(*recipe, storedVersion);
+    }
+    return recipe;
+}
+
+vector<shared_ptr<Recipe>> CookBookDatabase::getAllRecipes(int parts) {
+    if (!conn_) return {};
     
-    string connInfo = "host=localhost dbname=cookbook user=cookbookuser password=cookbook123";
+    // Список и нужные дочерние таблицы: не больше четырех запросов в одном конвейере,
+    // сколько бы рецептов ни было
+    if (!beginPipeline()) return {};
     
-    conn_ = PQconnectdb(connInfo.c_str());
+    bool queued = queueAllRecipes(parts);
     
-    if (PQstatus(conn_) != CONNECTION_OK) {
-        lastError_ = PQerrorMessage(conn_);
-        cout << "Ошибка: " << lastError_ << endl;
-        return false;
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        return {};
     }
     
-    cout << "Подключение успешно!" << endl;
-    return createTables();
+    return readAllRecipes(parts, results);
 }
 
-void CookBookDatabase::disconnect() {
-    if (conn_) {
-        PQfinish(conn_);
-        conn_ = nullptr;
-    }
+bool CookBookDatabase::queueAllRecipes(int parts) {
+    bool queued = sendPrepared("get_all_recipes", {}, BINARY_FORMAT);
+    if (parts & RecipeIngredients) queued = queued && sendPrepared("get_all_ingredients", {}, BINARY_FORMAT);
+    if (parts & RecipeSteps) queued = queued && sendPrepared("get_all_steps", {}, BINARY_FORMAT);
+    if (parts & RecipeTags) queued = queued && sendPrepared("get_all_recipe_tags", {}, BINARY_FORMAT);
+    return queued;
 }
 
-bool CookBookDatabase::createTables() {
-    if (!conn_) {
-        lastError_ = "Нет подключения к БД";
-        return false;
+vector<shared_ptr<Recipe>> CookBookDatabase::readAllRecipes(int parts, const PGresults& results) {
+    vector<shared_ptr<Recipe>> recipes;
+    
+    const PGresult* res = results[0].get();
+    int rows = PQntuples(res);
+    recipes.reserve(rows);
+    
+    unordered_map<int, Recipe*> byId;
+    if (parts != RecipeSummary) {
+        byId.reserve(rows);
     }
     
-    // Создаем все таблицы
-    const char* queries[] = {
-        // Таблица рецептов
-        "CREATE TABLE IF NOT EXISTS recipes ("
-        "id SERIAL PRIMARY KEY,"
-        "name VARCHAR(255) NOT NULL,"
-        "description TEXT,"
-        "cooking_time INTEGER DEFAULT 0,"
-        "difficulty VARCHAR(50) DEFAULT 'Средний',"
-        "category VARCHAR(100) DEFAULT 'Основное',"
-        "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP);",
-        
-        // Таблица ингредиентов
-        "CREATE TABLE IF NOT EXISTS recipe_ingredients ("
-        "id SERIAL PRIMARY KEY,"
-        "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
-        "name VARCHAR(255) NOT NULL,"
-        "quantity VARCHAR(100),"
-        "unit VARCHAR(50),"
-        "sort_order INTEGER DEFAULT 0);",
-        
-        // Таблица шагов
-        "CREATE TABLE IF NOT EXISTS cooking_steps ("
-        "id SERIAL PRIMARY KEY,"
-        "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
-        "step_number INTEGER NOT NULL,"
-        "description TEXT NOT NULL,"
-        "sort_order INTEGER DEFAULT 0);",
-        
-        // Таблица тегов
-        "CREATE TABLE IF NOT EXISTS tags ("
-        "id SERIAL PRIMARY KEY,"
-        "name VARCHAR(100) UNIQUE NOT NULL);",
+    for (int i = 0; i < rows; ++i) {
+        auto recipe = make_shared<Recipe>(readRecipeSummary(res, i));
         
-        // Таблица связи рецептов и тегов
-        "CREATE TABLE IF NOT EXISTS recipe_tags ("
-        "recipe_id INTEGER REFERENCES recipes(id) ON DELETE CASCADE,"
-        "tag_id INTEGER REFERENCES tags(id) ON DELETE CASCADE,"
-        "PRIMARY KEY (recipe_id, tag_id));"
-    };
-    
-    for (const char* query : queries) {
-        if (!executeQuery(query)) {
-            return false;
+        if (parts != RecipeSummary) {
+            byId[recipe->getId()] = recipe.get();
         }
+        recipes.push_back(move(recipe));
     }
     
-    return true;
-}
-
-bool CookBookDatabase::executeQuery(const string& query) {
-    if (!conn_) {
-        lastError_ = "Нет подключения к БД";
-        return false;
+    size_t next = 1;
+    
+    if (parts & RecipeIngredients) {
+        const PGresult* children = results[next++].get();
+        stitchRows(children, byId, [&](Recipe& recipe, int row) {
+            recipe.addIngredient(Ingredient(
+                readText(children, row, 1),
+                readText(children, row, 2),
+                readText(children, row, 3)
+            ));
+        });
     }
     
-    PGresult* res = PQexec(conn_, query.c_str());
-    ExecStatusType status = PQresultStatus(res);
-    bool success = (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK);
+    if (parts & RecipeSteps) {
+        const PGresult* children = results[next++].get();
+        stitchRows(children, byId, [&](Recipe& recipe, int row) {
+            recipe.addStep(CookingStep(
+                readInt(children, row, 1),
+                readText(children, row, 2)
+            ));
+        });
+    }
     
-    if (!success) {
-        lastError_ = PQerrorMessage(conn_);
+    if (parts & RecipeTags) {
+        const PGresult* children = results[next++].get();
+        stitchRows(children, byId, [&](Recipe& recipe, int row) {
+            for (auto& tag : readTextArray(children, row, 1)) {
+                recipe.addTag(move(tag));
+            }
+        });
     }
     
-    PQclear(res);
-    return success;
+    return recipes;
 }
 
-int CookBookDatabase::addRecipe(Recipe& recipe) {
-    if (!conn_) return -1;
-    
-    string name = escapeString(recipe.getName());
-    string description = escapeString(recipe.getDescription());
-    string difficulty = escapeString(recipe.getDifficulty());
-    string category = escapeString(recipe.getCategory());
+vector<shared_ptr<Recipe>> CookBookDatabase::queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) {
+    if (!conn_) return {};
     
-    string query = "INSERT INTO recipes (name, description, cooking_time, difficulty, category) "
-                   "VALUES (" + name + ", " + description + ", " + 
-                   to_string(recipe.getCookingTime()) + ", " + difficulty + ", " + 
-                   category + ") RETURNING id;";
+    if (!beginPipeline()) return {};
     
-    PGresult* res = PQexec(conn_, query.c_str());
+    bool queued = queueQueryRecipes(filter, afterKey, limit);
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        lastError_ = PQerrorMessage(conn_);
-        PQclear(res);
-        return -1;
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        return {};
     }
     
-    int recipeId = atoi(PQgetvalue(res, 0, 0));
-    PQclear(res);
-    
-    recipe.setId(recipeId);
-    
-    saveRecipeIngredients(recipeId, recipe.getIngredients());
-    saveRecipeSteps(recipeId, recipe.getSteps());
-    saveRecipeTags(recipeId, recipe.getTags());
-    
-    return recipeId;
+    return readQueryRecipes(results);
 }
 
-string CookBookDatabase::escapeString(const string& str) {
-    if (!conn_ || str.empty()) return "''";
-    
-    char* escaped = PQescapeLiteral(conn_, str.c_str(), str.length());
-    if (!escaped) {
-        lastError_ = "Ошибка экранирования строки";
-        return "''";
-    }
-    
-    string result(escaped);
-    PQfreemem(escaped);
-    return result;
+bool CookBookDatabase::queueQueryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) {
+    RecipeQuery query = buildRecipeQuery(filter, afterKey, limit);
+    return sendQuery(query.sql.c_str(), query.params, BINARY_FORMAT);
 }
 
-shared_ptr<Recipe> CookBookDatabase::getRecipeById(int id) {
-    if (!conn_) return nullptr;
-    
-    string query = "SELECT name, description, cooking_time, difficulty, category "
-                   "FROM recipes WHERE id = " + to_string(id) + ";";
+vector<shared_ptr<Recipe>> CookBookDatabase::readQueryRecipes(const PGresults& results) {
+    vector<shared_ptr<Recipe>> recipes;
     
-    PGresult* res = PQexec(conn_, query.c_str());
+    const PGresult* res = results[0].get();
+    int rows = PQntuples(res);
+    recipes.reserve(rows);
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
-        PQclear(res);
-        return nullptr;
+    for (int i = 0; i < rows; ++i) {
+        recipes.push_back(make_shared<Recipe>(readStreamedRecipe(res, i)));
     }
     
-    auto recipe = make_shared<Recipe>(
-        PQgetvalue(res, 0, 0),
-        PQgetvalue(res, 0, 1)
-    );
+    return recipes;
+}
+
+vector<RecipeSearchResult> CookBookDatabase::searchRecipes(const string& text, const vector<string>& tags, int limit,
+                                                           const vector<int>& within) {
+    if (!conn_) return {};
     
-    recipe->setId(id);
-    recipe->setCookingTime(atoi(PQgetvalue(res, 0, 2)));
-    recipe->setDifficulty(PQgetvalue(res, 0, 3));
-    recipe->setCategory(PQgetvalue(res, 0, 4));
+    if (!beginPipeline()) return {};
     
-    PQclear(res);
+    bool queued = queueSearchRecipes(text, tags, limit, within);
     
-    // Загружаем ингредиенты
-    auto ingredients = getRecipeIngredients(id);
-    for (const auto& ing : ingredients) {
-        recipe->addIngredient(ing);
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        return {};
     }
     
-    // Загружаем шаги
-    auto steps = getRecipeSteps(id);
-    for (const auto& step : steps) {
-        recipe->addStep(step);
+    return readSearchRecipes(results);
+}
+
+bool CookBookDatabase::queueSearchRecipes(const string& text, const vector<string>& tags, int limit,
+                                          const vector<int>& within) {
+    // Запрос без единого слова ничего не найдет — отвечаем пустой выборкой,
+    // чтобы число результатов в конвейере не зависело от текста
+    string tsQuery = toPrefixTsQuery(text);
+    if (tsQuery.empty()) {
+        return sendQuery("SELECT 1 WHERE false;");
     }
     
-    // Загружаем теги
-    auto tags = getRecipeTags(id);
-    for (const auto& tag : tags) {
-        recipe->addTag(tag);
+    RecipeQuery query = buildSearchQuery(tsQuery, tags, limit, within);
+    return sendQuery(query.sql.c_str(), query.params, BINARY_FORMAT);
+}
+
+vector<RecipeSearchResult> CookBookDatabase::readSearchRecipes(const PGresults& results) {
+    vector<RecipeSearchResult> found;
+    
+    const PGresult* res = results[0].get();
+    int rows = PQntuples(res);
+    found.reserve(rows);
+    
+    for (int i = 0; i < rows; ++i) {
+        RecipeSearchResult result;
+        result.id = readInt(res, i, 0);
+        result.name = readText(res, i, 1);
+        result.rank = readFloat(res, i, 2);
+        result.snippet = readText(res, i, 3);
+        result.tags = readTextArray(res, i, 4);
+        found.push_back(move(result));
     }
     
-    return recipe;
+    return found;
 }
 
-vector<shared_ptr<Recipe>> CookBookDatabase::getAllRecipes() {
-    vector<shared_ptr<Recipe>> recipes;
+bool CookBookDatabase::forEachRecipe(const function<bool(Recipe&&)>& consumer) {
+    if (!conn_) {
+        lastError_ = "Нет подключения к БД";
+        return false;
+    }
     
-    if (!conn_) return recipes;
+    if (!queueRecipeStream()) return false;
     
-    string query = "SELECT id, name, description, cooking_time, difficulty, category "
-                   "FROM recipes ORDER BY name;";
-    PGresult* res = PQexec(conn_, query.c_str());
+    // Каждая строка приходит отдельным PGresult, поэтому в памяти держится
+    // только текущий рецепт, а первые строки доступны до конца выборки.
+    // Если режим не включился, все строки придут одним результатом
+    PQsetSingleRowMode(conn_);
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        PQclear(res);
-        return recipes;
-    }
+    bool success = true;
+    bool stopped = false;
     
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i) {
-        int id = atoi(PQgetvalue(res, i, 0));
-        
-        auto recipe = make_shared<Recipe>(
-            PQgetvalue(res, i, 1),
-            PQgetvalue(res, i, 2)
-        );
+    while (PGresult* raw = PQgetResult(conn_)) {
+        PGresultPtr res(raw);
+        ExecStatusType status = PQresultStatus(res.get());
         
-        recipe->setId(id);
-        recipe->setCookingTime(atoi(PQgetvalue(res, i, 3)));
-        recipe->setDifficulty(PQgetvalue(res, i, 4));
-        recipe->setCategory(PQgetvalue(res, i, 5));
+        if (status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK) {
+            lastError_ = PQresultErrorMessage(res.get());
+            success = false;
+            continue;
+        }
         
-        recipes.push_back(recipe);
+        // Завершающий PGRES_TUPLES_OK пуст, если построчный режим включился
+        for (int row = 0; !stopped && row < PQntuples(res.get()); ++row) {
+            if (!consumer(readStreamedRecipe(res.get(), row))) {
+                // Остаток выборки не нужен — просим сервер прервать запрос
+                // и дочитываем то, что уже успело прийти
+                stopped = true;
+                if (PGcancel* cancel = PQgetCancel(conn_)) {
+                    char error[256];
+                    PQcancel(cancel, error, sizeof(error));
+                    PQfreeCancel(cancel);
+                }
+            }
+        }
     }
     
-    PQclear(res);
-    return recipes;
+    // Ошибка от отмененного запроса ожидаема и неудачей не считается
+    return success || stopped;
 }
 
-bool CookBookDatabase::deleteRecipe(int recipeId) {
-    if (!conn_ || recipeId <= 0) return false;
-    
-    string query = "DELETE FROM recipes WHERE id = " + to_string(recipeId) + ";";
-    return executeQuery(query);
+bool CookBookDatabase::queueRecipeStream() {
+    return sendPrepared("stream_recipes", {}, BINARY_FORMAT);
 }
 
-vector<Ingredient> CookBookDatabase::getRecipeIngredients(int recipeId) {
-    vector<Ingredient> ingredients;
-    
-    if (!conn_) return ingredients;
+Recipe CookBookDatabase::readStreamedRecipe(const PGresult* res, int row) {
+    Recipe recipe = readRecipeSummary(res, row);
+    for (auto& tag : readTextArray(res, row, 6)) {
+        recipe.addTag(move(tag));
+    }
+    return recipe;
+}
+
+bool CookBookDatabase::deleteRecipe(int recipeId, RecipeChange* change) {
+    if (!conn_ || recipeId <= 0) return false;
     
-    string query = "SELECT name, quantity, unit FROM recipe_ingredients "
-                   "WHERE recipe_id = " + to_string(recipeId) + " ORDER BY sort_order;";
+    if (!executePrepared("delete_recipe", {to_string(recipeId)})) {
+        return false;
+    }
     
-    PGresult* res = PQexec(conn_, query.c_str());
+    if (cache_) {
+        cache_->erase(recipeId);
+    }
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        PQclear(res);
-        return ingredients;
+    // Теги остаются в базе и после удаления последнего рецепта с ними
+    if (change) {
+        *change = RecipeChange();
+        change->kind = RecipeChange::Removed;
+        change->id = recipeId;
     }
+    return true;
+}
+
+bool CookBookDatabase::startCopy(const char* sql) {
+    PGresultPtr res(PQexec(conn_, sql));
     
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i) {
-        ingredients.push_back(Ingredient(
-            PQgetvalue(res, i, 0),
-            PQgetvalue(res, i, 1),
-            PQgetvalue(res, i, 2)
-        ));
+    if (PQresultStatus(res.get()) != PGRES_COPY_IN) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
     }
     
-    PQclear(res);
-    return ingredients;
+    return true;
 }
 
-vector<CookingStep> CookBookDatabase::getRecipeSteps(int recipeId) {
-    vector<CookingStep> steps;
+bool CookBookDatabase::putCopyData(string& buffer) {
+    if (buffer.size() < COPY_CHUNK_SIZE) {
+        return true;
+    }
     
-    if (!conn_) return steps;
+    if (PQputCopyData(conn_, buffer.data(), static_cast<int>(buffer.size())) != 1) {
+        lastError_ = PQerrorMessage(conn_);
+        return false;
+    }
     
-    string query = "SELECT step_number, description FROM cooking_steps "
-                   "WHERE recipe_id = " + to_string(recipeId) + " ORDER BY sort_order;";
+    buffer.clear();
+    return true;
+}
+
+bool CookBookDatabase::finishCopy(string& buffer) {
+    bool success = buffer.empty() ||
+                   PQputCopyData(conn_, buffer.data(), static_cast<int>(buffer.size())) == 1;
+    buffer.clear();
+    
+    // При ошибке отправки просим сервер отменить COPY
+    if (PQputCopyEnd(conn_, success ? nullptr : "client error") != 1) {
+        success = false;
+    }
     
-    PGresult* res = PQexec(conn_, query.c_str());
+    PGresultPtr res(PQgetResult(conn_));
+    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK) {
+        success = false;
+    }
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        PQclear(res);
-        return steps;
+    if (!success) {
+        lastError_ = PQerrorMessage(conn_);
     }
     
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i) {
-        steps.push_back(CookingStep(
-            atoi(PQgetvalue(res, i, 0)),
-            PQgetvalue(res, i, 1)
-        ));
+    while (PGresult* extra = PQgetResult(conn_)) {
+        PQclear(extra);
     }
     
-    PQclear(res);
-    return steps;
+    return success;
 }
 
-vector<string> CookBookDatabase::getRecipeTags(int recipeId) {
-    vector<string> tags;
+bool CookBookDatabase::copyRecipes(const vector<Recipe>& recipes) {
+    if (!startCopy("COPY recipes (id, name, description, cooking_time, difficulty, category) "
+                   "FROM STDIN;")) {
+        return false;
+    }
+    
+    string buffer;
+    bool success = true;
     
-    if (!conn_) return tags;
+    for (const auto& recipe : recipes) {
+        appendCopyField(buffer, recipe.getId());
+        appendCopyField(buffer, recipe.getName());
+        appendCopyField(buffer, recipe.getDescription());
+        appendCopyField(buffer, recipe.getCookingTime());
+        appendCopyField(buffer, recipe.getDifficulty());
+        appendCopyField(buffer, recipe.getCategory(), '\n');
+        
+        if (!putCopyData(buffer)) {
+            success = false;
+            break;
+        }
+    }
     
-    string query = "SELECT t.name FROM tags t "
-                   "JOIN recipe_tags rt ON t.id = rt.tag_id "
-                   "WHERE rt.recipe_id = " + to_string(recipeId) + " ORDER BY t.name;";
+    return finishCopy(buffer) && success;
+}
+
+bool CookBookDatabase::copyRecipeIngredients(const vector<Recipe>& recipes) {
+    if (!startCopy("COPY recipe_ingredients (recipe_id, name, quantity, unit, sort_order) "
+                   "FROM STDIN;")) {
+        return false;
+    }
     
-    PGresult* res = PQexec(conn_, query.c_str());
+    string buffer;
+    bool success = true;
+    
+    for (const auto& recipe : recipes) {
+        const auto& ingredients = recipe.getIngredients();
+        for (size_t i = 0; success && i < ingredients.size(); ++i) {
+            appendCopyField(buffer, recipe.getId());
+            appendCopyField(buffer, ingredients[i].getName());
+            appendCopyField(buffer, ingredients[i].getQuantity());
+            appendCopyField(buffer, ingredients[i].getUnit());
+            appendCopyField(buffer, static_cast<long long>(i), '\n');
+            
+            success = putCopyData(buffer);
+        }
+        
+        if (!success) break;
+    }
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        PQclear(res);
-        return tags;
+    return finishCopy(buffer) && success;
+}
+
+bool CookBookDatabase::copyRecipeSteps(const vector<Recipe>& recipes) {
+    if (!startCopy("COPY cooking_steps (recipe_id, step_number, description, sort_order) "
+                   "FROM STDIN;")) {
+        return false;
     }
     
-    int rows = PQntuples(res);
-    for (int i = 0; i < rows; ++i) {
-        tags.push_back(PQgetvalue(res, i, 0));
+    string buffer;
+    bool success = true;
+    
+    for (const auto& recipe : recipes) {
+        const auto& steps = recipe.getSteps();
+        for (size_t i = 0; success && i < steps.size(); ++i) {
+            appendCopyField(buffer, recipe.getId());
+            appendCopyField(buffer, steps[i].getStepNumber());
+            appendCopyField(buffer, steps[i].getDescription());
+            appendCopyField(buffer, static_cast<long long>(i), '\n');
+            
+            success = putCopyData(buffer);
+        }
+        
+        if (!success) break;
     }
     
-    PQclear(res);
-    return tags;
+    return finishCopy(buffer) && success;
 }
 
 bool CookBookDatabase::saveRecipeIngredients(int recipeId, const vector<Ingredient>& ingredients) {
-    if (!conn_) return false;
+    string id = to_string(recipeId);
     
     // Удаляем старые ингредиенты
-    string deleteQuery = "DELETE FROM recipe_ingredients WHERE recipe_id = " + to_string(recipeId) + ";";
-    executeQuery(deleteQuery);
+    if (!sendPrepared("delete_recipe_ingredients", {id})) {
+        return false;
+    }
     
     // Добавляем новые
     for (size_t i = 0; i < ingredients.size(); ++i) {
         const auto& ing = ingredients[i];
         
-        string name = escapeString(ing.getName());
-        string quantity = escapeString(ing.getQuantity());
-        string unit = escapeString(ing.getUnit());
-        
-        string query = "INSERT INTO recipe_ingredients (recipe_id, name, quantity, unit, sort_order) "
-                       "VALUES (" + to_string(recipeId) + ", " + name + ", " + quantity + ", " + unit + ", " + to_string(i) + ");";
-        
-        if (!executeQuery(query)) {
+        if (!sendPrepared("insert_recipe_ingredient",
+                          {id, ing.getName(), ing.getQuantity(), ing.getUnit(), to_string(i)})) {
             return false;
         }
     }
@@ -352,23 +1781,19 @@ bool CookBookDatabase::saveRecipeIngredients(int recipeId, const vector<Ingredie
 }
 
 bool CookBookDatabase::saveRecipeSteps(int recipeId, const vector<CookingStep>& steps) {
-    if (!conn_) return false;
+    string id = to_string(recipeId);
     
     // Удаляем старые шаги
-    string deleteQuery = "DELETE FROM cooking_steps WHERE recipe_id = " + to_string(recipeId) + ";";
-    executeQuery(deleteQuery);
+    if (!sendPrepared("delete_recipe_steps", {id})) {
+        return false;
+    }
     
     // Добавляем новые
     for (size_t i = 0; i < steps.size(); ++i) {
         const auto& step = steps[i];
         
-        string description = escapeString(step.getDescription());
-        
-        string query = "INSERT INTO cooking_steps (recipe_id, step_number, description, sort_order) "
-                       "VALUES (" + to_string(recipeId) + ", " + to_string(step.getStepNumber()) + ", " + 
-                       description + ", " + to_string(i) + ");";
-        
-        if (!executeQuery(query)) {
+        if (!sendPrepared("insert_cooking_step",
+                          {id, to_string(step.getStepNumber()), step.getDescription(), to_string(i)})) {
             return false;
         }
     }
@@ -377,90 +1802,222 @@ bool CookBookDatabase::saveRecipeSteps(int recipeId, const vector<CookingStep>&
 }
 
 bool CookBookDatabase::saveRecipeTags(int recipeId, const vector<string>& tags) {
-    if (!conn_) return false;
-    
     // Удаляем старые связи
-    string deleteQuery = "DELETE FROM recipe_tags WHERE recipe_id = " + to_string(recipeId) + ";";
-    executeQuery(deleteQuery);
+    if (!sendPrepared("delete_recipe_tags", {to_string(recipeId)})) {
+        return false;
+    }
+    
+    return linkRecipeTags(recipeId, tags);
+}
+
+bool CookBookDatabase::linkRecipeTags(int recipeId, const vector<string>& tags) {
+    if (tags.empty()) {
+        return true;
+    }
     
-    // Добавляем новые теги
+    // Известные теги идут сразу идентификаторами, остальные создаются на сервере
+    vector<int> knownIds;
+    vector<string> newNames;
+    unordered_set<string> seen;
     for (const auto& tagName : tags) {
-        string tag = escapeString(tagName);
+        if (!seen.insert(tagName).second) continue;
+        
+        auto it = tagIds_.find(tagName);
+        if (it != tagIds_.end()) {
+            knownIds.push_back(it->second);
+        } else {
+            newNames.push_back(tagName);
+        }
+    }
+    
+    tagResultSlots_.push_back(pipelineQueued_);
+    return sendPrepared("link_recipe_tags", {to_string(recipeId), toArrayLiteral(newNames), toArrayLiteral(knownIds)});
+}
+
+bool CookBookDatabase::saveChangedIngredients(int recipeId, const vector<Ingredient>& ingredients,
+                                              const vector<Ingredient>& stored) {
+    string id = to_string(recipeId);
+    size_t common = min(ingredients.size(), stored.size());
+    
+    // Позиции, которые есть и там и там, обновляются только при отличии
+    for (size_t i = 0; i < common; ++i) {
+        const auto& ing = ingredients[i];
+        const auto& old = stored[i];
+        if (ing.getName() == old.getName() && ing.getQuantity() == old.getQuantity() &&
+            ing.getUnit() == old.getUnit()) {
+            continue;
+        }
         
-        // Получаем или создаем тег
-        string tagQuery = "SELECT id FROM tags WHERE name = " + tag + ";";
-        PGresult* res = PQexec(conn_, tagQuery.c_str());
+        if (!sendPrepared("update_recipe_ingredient",
+                          {id, to_string(i), ing.getName(), ing.getQuantity(), ing.getUnit()})) {
+            return false;
+        }
+    }
+    
+    for (size_t i = common; i < ingredients.size(); ++i) {
+        const auto& ing = ingredients[i];
         
-        int tagId = -1;
-        if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) > 0) {
-            tagId = atoi(PQgetvalue(res, 0, 0));
+        if (!sendPrepared("insert_recipe_ingredient",
+                          {id, ing.getName(), ing.getQuantity(), ing.getUnit(), to_string(i)})) {
+            return false;
+        }
+    }
+    
+    return stored.size() <= common ||
+           sendPrepared("delete_recipe_ingredients_from", {id, to_string(common)});
+}
+
+bool CookBookDatabase::saveChangedSteps(int recipeId, const vector<CookingStep>& steps,
+                                        const vector<CookingStep>& stored) {
+    string id = to_string(recipeId);
+    size_t common = min(steps.size(), stored.size());
+    
+    for (size_t i = 0; i < common; ++i) {
+        const auto& step = steps[i];
+        const auto& old = stored[i];
+        if (step.getStepNumber() == old.getStepNumber() && step.getDescription() == old.getDescription()) {
+            continue;
         }
-        PQclear(res);
         
-        if (tagId == -1) {
-            string insertQuery = "INSERT INTO tags (name) VALUES (" + tag + ") RETURNING id;";
-            res = PQexec(conn_, insertQuery.c_str());
-            
-            if (PQresultStatus(res) == PGRES_TUPLES_OK) {
-                tagId = atoi(PQgetvalue(res, 0, 0));
-            }
-            PQclear(res);
+        if (!sendPrepared("update_cooking_step",
+                          {id, to_string(i), to_string(step.getStepNumber()), step.getDescription()})) {
+            return false;
         }
+    }
+    
+    for (size_t i = common; i < steps.size(); ++i) {
+        const auto& step = steps[i];
         
-        // Связываем тег с рецептом
-        if (tagId != -1) {
-            string linkQuery = "INSERT INTO recipe_tags (recipe_id, tag_id) VALUES (" + to_string(recipeId) + ", " + to_string(tagId) + ");";
-            executeQuery(linkQuery);
+        if (!sendPrepared("insert_cooking_step",
+                          {id, to_string(step.getStepNumber()), step.getDescription(), to_string(i)})) {
+            return false;
         }
     }
     
-    return true;
+    return stored.size() <= common ||
+           sendPrepared("delete_recipe_steps_from", {id, to_string(common)});
+}
+
+bool CookBookDatabase::saveChangedTags(int recipeId, const vector<string>& tags, const vector<string>& stored) {
+    vector<string> current = sortedTags(tags);
+    vector<string> previous = sortedTags(stored);
+    
+    vector<string> added;
+    vector<string> removed;
+    set_difference(current.begin(), current.end(), previous.begin(), previous.end(), back_inserter(added));
+    set_difference(previous.begin(), previous.end(), current.begin(), current.end(), back_inserter(removed));
+    
+    if (!removed.empty() && !sendPrepared("unlink_recipe_tags", {to_string(recipeId), toArrayLiteral(removed)})) {
+        return false;
+    }
+    
+    return linkRecipeTags(recipeId, added);
+}
+
+void CookBookDatabase::rememberTagIds(const PGresults& results, vector<string>* createdTags) {
+    for (int slot : tagResultSlots_) {
+        const PGresult* res = results[slot].get();
+        int rows = PQntuples(res);
+        for (int i = 0; i < rows; ++i) {
+            tagIds_[PQgetvalue(res, i, 1)] = atoi(PQgetvalue(res, i, 0));
+            
+            // xmax = 0 только у строки, вставленной этим запросом, а не обновленной по конфликту
+            if (createdTags && PQgetvalue(res, i, 2)[0] == 't') {
+                createdTags->push_back(PQgetvalue(res, i, 1));
+            }
+        }
+    }
+    tagResultSlots_.clear();
+}
+
+void CookBookDatabase::forgetTagIds() {
+    // Кэш мог устареть (например, тег удален другим клиентом) — перечитаем при следующем запросе
+    tagIds_.clear();
+    tagResultSlots_.clear();
 }
 
-bool CookBookDatabase::updateRecipe(const Recipe& recipe) {
+bool CookBookDatabase::updateRecipe(const Recipe& recipe, RecipeChange* change) {
     if (!conn_) return false;
     
     int recipeId = recipe.getId();
     if (recipeId <= 0) return false;
     
-    string name = escapeString(recipe.getName());
-    string description = escapeString(recipe.getDescription());
-    string difficulty = escapeString(recipe.getDifficulty());
-    string category = escapeString(recipe.getCategory());
+    // Разница считается от сохраненного рецепта; после просмотра он обычно уже в кэше
+    int storedVersion = 0;
+    shared_ptr<Recipe> stored = loadRecipe(recipeId, &storedVersion);
+    
+    // Ничего не изменилось — записывать нечего
+    if (stored && stored->contentHash() == recipe.contentHash()) {
+        if (change) {
+            *change = RecipeChange();
+            change->kind = RecipeChange::Updated;
+            change->id = recipeId;
+            change->name = recipe.getName();
+            change->tags = sortedTags(recipe.getTags());
+        }
+        return true;
+    }
+    
+    if (stored) {
+        bool conflict = false;
+        if (writeRecipeChanges(recipe, *stored, storedVersion, change, &conflict)) return true;
+        if (!conflict) return false;
+        
+        // Рецепт успели изменить с другого клиента — переписываем его целиком
+        if (cache_) {
+            cache_->erase(recipeId);
+        }
+    }
     
-    string query = "UPDATE recipes SET name = " + name + ", description = " + description + 
-                   ", cooking_time = " + to_string(recipe.getCookingTime()) + 
-                   ", difficulty = " + difficulty + ", category = " + category + 
-                   " WHERE id = " + to_string(recipeId) + ";";
+    return writeRecipe(recipe, recipeId, false, change);
+}
+
+bool CookBookDatabase::getRecipeVersions(unordered_map<int, int>& versions) {
+    versions.clear();
+    if (!conn_) return false;
     
-    if (!executeQuery(query)) {
+    PGresultPtr res = execPrepared("get_recipe_versions", {});
+    if (PQresultStatus(res.get()) != PGRES_TUPLES_OK) {
         return false;
     }
     
-    saveRecipeIngredients(recipeId, recipe.getIngredients());
-    saveRecipeSteps(recipeId, recipe.getSteps());
-    saveRecipeTags(recipeId, recipe.getTags());
-    
+    int rows = PQntuples(res.get());
+    versions.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        versions[atoi(PQgetvalue(res.get(), i, 0))] = atoi(PQgetvalue(res.get(), i, 1));
+    }
     return true;
 }
 
 vector<string> CookBookDatabase::getAllTags() {
-    vector<string> tags;
+    if (!conn_) return {};
     
-    if (!conn_) return tags;
+    if (!beginPipeline()) return {};
     
-    PGresult* res = PQexec(conn_, "SELECT name FROM tags ORDER BY name;");
+    bool queued = queueAllTags();
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        PQclear(res);
-        return tags;
+    PGresults results;
+    if (!syncPipeline(results) || !queued) {
+        return {};
     }
     
+    return readAllTags(results);
+}
+
+bool CookBookDatabase::queueAllTags() {
+    return sendPrepared("get_all_tags", {}, BINARY_FORMAT);
+}
+
+vector<string> CookBookDatabase::readAllTags(const PGresults& results) {
+    vector<string> tags;
+    
+    const PGresult* res = results[0].get();
     int rows = PQntuples(res);
+    tags.reserve(rows);
     for (int i = 0; i < rows; ++i) {
-        tags.push_back(PQgetvalue(res, i, 0));
+        tags.push_back(readText(res, i, 0));
+        tagIds_[tags.back()] = readInt(res, i, 1);
     }
     
-    PQclear(res);
     return tags;
 }
\ No newline at end of file
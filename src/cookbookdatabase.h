@@ -3,44 +3,153 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include <libpq-fe.h>
+#include "reciperepository.h"
 using namespace std;
-class Recipe;
 class Ingredient;
 class CookingStep;
+class AsyncCookBookDatabase;
+class RecipeCache;
 
-class CookBookDatabase {
+struct PGresultDeleter {
+    void operator()(PGresult* res) const { PQclear(res); }
+};
+using PGresultPtr = unique_ptr<PGresult, PGresultDeleter>;
+using PGresults = vector<PGresultPtr>;
+
+// Хранилище рецептов в PostgreSQL через libpq
+class CookBookDatabase : public RecipeRepository {
 public:
     CookBookDatabase();
-    ~CookBookDatabase();
+    ~CookBookDatabase() override;
     
     bool connect();
     void disconnect();
     bool isConnected() const { return conn_ != nullptr; }
+    bool isHealthy() const;
+    bool ping();
+    int backendPid() const;
+    
+    // Общий кэш рецептов: getRecipeById читает из него, запись и удаление
+    // обновляют его сразу после COMMIT
+    void setRecipeCache(shared_ptr<RecipeCache> cache);
+    
+    // Если задан change, в него записывается, что изменилось в списке рецептов
+    int addRecipe(Recipe& recipe, RecipeChange* change = nullptr) override;
+    bool addRecipes(vector<Recipe>& recipes) override;
+    bool updateRecipe(const Recipe& recipe, RecipeChange* change = nullptr) override;
+    bool deleteRecipe(int recipeId, RecipeChange* change = nullptr) override;
+    shared_ptr<Recipe> getRecipeById(int id) override;
+    vector<shared_ptr<Recipe>> getAllRecipes(int parts = RecipeSummary) override;
+    
+    // Страница списка с тегами после ключа afterKey. Ключ следующей страницы —
+    // имя и id последнего рецепта; страница короче limit — последняя
+    vector<shared_ptr<Recipe>> queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) override;
     
-    int addRecipe(Recipe& recipe);
-    bool updateRecipe(const Recipe& recipe);
-    bool deleteRecipe(int recipeId);
-    shared_ptr<Recipe> getRecipeById(int id);
-    vector<shared_ptr<Recipe>> getAllRecipes();
+    // Полнотекстовый поиск по названию, описанию, ингредиентам и шагам;
+    // лучшие limit совпадений по убыванию релевантности, только с тегами tags.
+    // Непустой within ограничивает поиск этими рецептами (сужение прошлого поиска)
+    vector<RecipeSearchResult> searchRecipes(const string& text, const vector<string>& tags = {}, int limit = 50,
+                                             const vector<int>& within = {}) override;
     
-    vector<string> getAllTags();
+    // Выдает рецепты с тегами по одному, по мере прихода строк с сервера.
+    // consumer возвращает false, чтобы остановить выборку
+    bool forEachRecipe(const function<bool(Recipe&&)>& consumer) override;
     
-    string getLastError() const { return lastError_; }
+    vector<string> getAllTags() override;
+    
+    // id -> версия строки рецепта для всех рецептов
+    bool getRecipeVersions(unordered_map<int, int>& versions) override;
+    
+    string getLastError() const override { return lastError_; }
+    
+    static const char* connectionInfo();
     
 private:
-    bool createTables();
+    friend class AsyncCookBookDatabase;
+    
+    bool migrateSchema();
+    // Номера примененных миграций; пусто, если таблицы версий еще нет
+    bool appliedMigrations(unordered_set<int>& versions);
+    bool prepareStatements();
+    bool queuePrepareStatements();
+    
+    // Подписка на уведомления об изменениях и разбор уже полученных
+    bool queueListen();
+    vector<ChangeNotification> takeNotifications();
+    // Подписка действует: уведомления удаляют устаревшие записи кэша
+    void setListening(bool listening);
+    
+    // Загрузчики разделены на постановку запросов в конвейер и разбор ответов,
+    // чтобы их же использовала асинхронная обертка
+    shared_ptr<Recipe> loadRecipe(int id, int* version);
+    shared_ptr<Recipe> cachedRecipe(int id, int* checkVersion, int* version = nullptr);
+    bool queueRecipeById(int id, int knownVersion = 0);
+    // knownVersion — версия рецепта из кэша, которую нужно сверить с базой;
+    // в version пишется версия, которой соответствует возвращенный рецепт
+    shared_ptr<Recipe> readRecipeById(int id, const PGresults& results, shared_ptr<Recipe> cached = nullptr,
+                                      int knownVersion = 0, int* version = nullptr);
+    bool queueAllRecipes(int parts);
+    vector<shared_ptr<Recipe>> readAllRecipes(int parts, const PGresults& results);
+    bool queueAllTags();
+    vector<string> readAllTags(const PGresults& results);
+    bool queueQueryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit);
+    vector<shared_ptr<Recipe>> readQueryRecipes(const PGresults& results);
+    bool queueSearchRecipes(const string& text, const vector<string>& tags, int limit, const vector<int>& within);
+    vector<RecipeSearchResult> readSearchRecipes(const PGresults& results);
+    bool queueRecipeStream();
+    static Recipe readStreamedRecipe(const PGresult* res, int row);
+    
+    // Пишут запись рецепта в открытый конвейер одной транзакцией
+    bool writeRecipe(const Recipe& recipe, int recipeId, bool isNew, RecipeChange* change = nullptr);
     bool saveRecipeTags(int recipeId, const vector<string>& tags);
+    bool linkRecipeTags(int recipeId, const vector<string>& tags);
     bool saveRecipeIngredients(int recipeId, const vector<Ingredient>& ingredients);
     bool saveRecipeSteps(int recipeId, const vector<CookingStep>& steps);
     
-    vector<string> getRecipeTags(int recipeId);
-    vector<Ingredient> getRecipeIngredients(int recipeId);
-    vector<CookingStep> getRecipeSteps(int recipeId);
+    // Правка только отличий от stored — версии storedVersion того же рецепта.
+    // conflict — рецепт с тех пор изменился, разницу нужно пересчитать
+    bool writeRecipeChanges(const Recipe& recipe, const Recipe& stored, int storedVersion,
+                            RecipeChange* change, bool* conflict);
+    bool saveChangedIngredients(int recipeId, const vector<Ingredient>& ingredients, const vector<Ingredient>& stored);
+    bool saveChangedSteps(int recipeId, const vector<CookingStep>& steps, const vector<CookingStep>& stored);
+    bool saveChangedTags(int recipeId, const vector<string>& tags, const vector<string>& stored);
+    // После COMMIT: рецепт в кэш, новые теги в кэш тегов, описание изменения в change
+    void finishRecipeWrite(const Recipe& recipe, int recipeId, bool isNew,
+                           const PGresults& results, RecipeChange* change);
+    void rememberTagIds(const PGresults& results, vector<string>* createdTags = nullptr);
+    void forgetTagIds();
     
-    string escapeString(const string& str);
     bool executeQuery(const string& query);
+    PGresultPtr execPrepared(const char* name, const vector<string>& params);
+    bool executePrepared(const char* name, const vector<string>& params);
+    
+    // Конвейер: запросы уходят пачкой, ответы читаются за один round trip
+    bool beginPipeline();
+    bool sendPrepared(const char* name, const vector<string>& params, int resultFormat = 0);
+    bool sendQuery(const char* sql, const vector<string>& params = {}, int resultFormat = 0);
+    bool syncPipeline(PGresults& results);
+    void rollbackTransaction();
+    
+    // Потоковая загрузка строк через COPY ... FROM STDIN
+    bool startCopy(const char* sql);
+    bool putCopyData(string& buffer);
+    bool finishCopy(string& buffer);
+    bool copyRecipes(const vector<Recipe>& recipes);
+    bool copyRecipeIngredients(const vector<Recipe>& recipes);
+    bool copyRecipeSteps(const vector<Recipe>& recipes);
     
     PGconn* conn_;
+    int pipelineQueued_;
     string lastError_;
+    
+    // Кэш имя тега -> id; пополняется только после успешного COMMIT
+    unordered_map<string, int> tagIds_;
+    vector<int> tagResultSlots_;
+    
+    shared_ptr<RecipeCache> cache_;
+    bool listening_;
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "cookbookdatabasepool.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Соединение, простоявшее дольше, перед выдачей проверяется запросом к серверу
+const chrono::seconds HEALTH_CHECK_IDLE(30);
+
+}
+
+CookBookDatabasePool::Handle::Handle(Handle&& other) noexcept
+    : pool_(other.pool_), slot_(other.slot_) {
+    other.pool_ = nullptr;
+    other.slot_ = nullptr;
+}
+
+CookBookDatabasePool::Handle& CookBookDatabasePool::Handle::operator=(Handle&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        slot_ = other.slot_;
+        other.pool_ = nullptr;
+        other.slot_ = nullptr;
+    }
+    return *this;
+}
+
+CookBookDatabasePool::Handle::~Handle() {
+    release();
+}
+
+void CookBookDatabasePool::Handle::release() {
+    if (pool_ && slot_) {
+        pool_->release(slot_);
+    }
+    pool_ = nullptr;
+    slot_ = nullptr;
+}
+
+CookBookDatabasePool::CookBookDatabasePool(size_t size, shared_ptr<RecipeCache> cache)
+    : size_(max<size_t>(size, 1)), cache_(move(cache)) {
+    slots_.reserve(size_);
+}
+
+CookBookDatabasePool::~CookBookDatabasePool() {
+    // Все Handle должны быть возвращены раньше, чем уничтожается пул
+    lock_guard<mutex> lock(mutex_);
+    idle_.clear();
+    slots_.clear();
+}
+
+CookBookDatabasePool::Handle CookBookDatabasePool::acquire() {
+    unique_lock<mutex> lock(mutex_);
+    available_.wait(lock, [this] { return !idle_.empty() || slots_.size() < size_; });
+    return checkout(lock);
+}
+
+CookBookDatabasePool::Handle CookBookDatabasePool::tryAcquire(chrono::milliseconds timeout) {
+    unique_lock<mutex> lock(mutex_);
+    if (!available_.wait_for(lock, timeout, [this] { return !idle_.empty() || slots_.size() < size_; })) {
+        lastError_ = "Нет свободных соединений с БД";
+        return Handle();
+    }
+    return checkout(lock);
+}
+
+CookBookDatabasePool::Handle CookBookDatabasePool::checkout(unique_lock<mutex>& lock) {
+    Slot* slot;
+    
+    if (!idle_.empty()) {
+        slot = idle_.back();
+        idle_.pop_back();
+    } else {
+        // Соединения создаются по мере надобности, пока не достигнут размер пула
+        slots_.push_back(make_unique<Slot>());
+        slot = slots_.back().get();
+        slot->database = make_unique<CookBookDatabase>();
+        slot->database->setRecipeCache(cache_);
+    }
+    
+    // Проверка и переподключение идут без блокировки пула
+    lock.unlock();
+    
+    if (!ensureHealthy(*slot)) {
+        release(slot);
+        return Handle();
+    }
+    
+    return Handle(this, slot);
+}
+
+bool CookBookDatabasePool::ensureHealthy(Slot& slot) {
+    CookBookDatabase& database = *slot.database;
+    
+    bool healthy = database.isHealthy();
+    if (healthy && chrono::steady_clock::now() - slot.releasedAt > HEALTH_CHECK_IDLE) {
+        healthy = database.ping();
+    }
+    
+    if (healthy) {
+        return true;
+    }
+    
+    // Разорванное или новое соединение открываем заново; подключения идут по одному,
+    // чтобы проверка схемы не выполнялась параллельно
+    database.disconnect();
+    
+    bool connected;
+    {
+        lock_guard<mutex> connectLock(connectMutex_);
+        connected = database.connect();
+    }
+    
+    lock_guard<mutex> lock(mutex_);
+    if (connected) {
+        slot.backendPid = database.backendPid();
+    } else {
+        slot.backendPid = 0;
+        lastError_ = database.getLastError();
+    }
+    
+    return connected;
+}
+
+void CookBookDatabasePool::release(Slot* slot) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        slot->releasedAt = chrono::steady_clock::now();
+        idle_.push_back(slot);
+    }
+    available_.notify_one();
+}
+
+bool CookBookDatabasePool::isOwnBackend(int pid) const {
+    if (pid == 0) return false;
+    
+    lock_guard<mutex> lock(mutex_);
+    for (const auto& slot : slots_) {
+        if (slot->backendPid == pid) return true;
+    }
+    return false;
+}
+
+string CookBookDatabasePool::getLastError() const {
+    lock_guard<mutex> lock(mutex_);
+    return lastError_;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "cookbookdatabase.h"
+using namespace std;
+
+// Пул соединений для работы с БД из нескольких потоков.
+// Каждое соединение — отдельный CookBookDatabase со своими подготовленными запросами;
+// одновременно им владеет только один держатель Handle.
+class CookBookDatabasePool {
+    struct Slot {
+        unique_ptr<CookBookDatabase> database;
+        chrono::steady_clock::time_point releasedAt;
+        int backendPid = 0;
+    };
+
+public:
+    // Выданное соединение; возвращается в пул при уничтожении
+    class Handle {
+    public:
+        Handle() : pool_(nullptr), slot_(nullptr) {}
+        Handle(Handle&& other) noexcept;
+        Handle& operator=(Handle&& other) noexcept;
+        ~Handle();
+        
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        
+        explicit operator bool() const { return slot_ != nullptr; }
+        CookBookDatabase* operator->() const { return slot_->database.get(); }
+        CookBookDatabase& operator*() const { return *slot_->database; }
+        
+        void release();
+    
+    private:
+        friend class CookBookDatabasePool;
+        Handle(CookBookDatabasePool* pool, Slot* slot) : pool_(pool), slot_(slot) {}
+        
+        CookBookDatabasePool* pool_;
+        Slot* slot_;
+    };
+    
+    // cache, если задан, получают все соединения пула
+    explicit CookBookDatabasePool(size_t size = 4, shared_ptr<RecipeCache> cache = nullptr);
+    ~CookBookDatabasePool();
+    
+    CookBookDatabasePool(const CookBookDatabasePool&) = delete;
+    CookBookDatabasePool& operator=(const CookBookDatabasePool&) = delete;
+    
+    // Ждет свободное соединение; пустой Handle — не удалось подключиться
+    Handle acquire();
+    Handle tryAcquire(chrono::milliseconds timeout);
+    
+    size_t size() const { return size_; }
+    
+    // Запись сделана одним из соединений пула — по pid процесса сервера
+    bool isOwnBackend(int pid) const;
+    string getLastError() const;
+
+private:
+    Handle checkout(unique_lock<mutex>& lock);
+    bool ensureHealthy(Slot& slot);
+    void release(Slot* slot);
+    
+    const size_t size_;
+    shared_ptr<RecipeCache> cache_;
+    vector<unique_ptr<Slot>> slots_;
+    vector<Slot*> idle_;
+    
+    mutable mutex mutex_;
+    condition_variable available_;
+    mutex connectMutex_;
+    string lastError_;
+};
\ No newline at end of file
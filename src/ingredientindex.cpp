@@ -0,0 +1,165 @@
+#include "ingredientindex.h"
+#include "recipe.h"
+#include "textfold.h"
+#include <algorithm>
+
+using namespace std;
+
+void IngredientIndex::clear() {
+    ingredientIds_.clear();
+    postings_.clear();
+    recipeIngredients_.clear();
+    ingredientCounts_.clear();
+}
+
+void IngredientIndex::build(const vector<shared_ptr<Recipe>>& recipes) {
+    clear();
+    recipeIngredients_.reserve(recipes.size());
+    
+    for (const auto& recipe : recipes) {
+        add(*recipe);
+    }
+}
+
+void IngredientIndex::add(const Recipe& recipe) {
+    int recipeId = recipe.getId();
+    if (recipeId <= 0) return;
+    
+    remove(recipeId);
+    
+    // Одинаковые после нормализации названия считаются одним ингредиентом
+    vector<int> ids;
+    ids.reserve(recipe.getIngredients().size());
+    for (const auto& ingredient : recipe.getIngredients()) {
+        string name = foldText(ingredient.getName());
+        if (name.empty()) continue;
+        
+        auto inserted = ingredientIds_.emplace(move(name), static_cast<int>(postings_.size()));
+        if (inserted.second) {
+            postings_.emplace_back();
+        }
+        ids.push_back(inserted.first->second);
+    }
+    
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    
+    for (int id : ids) {
+        postings_[id].add(static_cast<uint32_t>(recipeId));
+    }
+    
+    // Идентификаторы рецептов идут из последовательности, поэтому плотные
+    if (ingredientCounts_.size() <= static_cast<size_t>(recipeId)) {
+        ingredientCounts_.resize(recipeId + 1, 0);
+    }
+    ingredientCounts_[recipeId] = static_cast<uint16_t>(min<size_t>(ids.size(), UINT16_MAX));
+    recipeIngredients_[recipeId] = move(ids);
+}
+
+void IngredientIndex::remove(int recipeId) {
+    auto it = recipeIngredients_.find(recipeId);
+    if (it == recipeIngredients_.end()) return;
+    
+    for (int id : it->second) {
+        postings_[id].remove(static_cast<uint32_t>(recipeId));
+    }
+    
+    ingredientCounts_[recipeId] = 0;
+    recipeIngredients_.erase(it);
+}
+
+int IngredientIndex::ingredientId(const string& name) const {
+    auto it = ingredientIds_.find(foldText(name));
+    return it != ingredientIds_.end() ? it->second : -1;
+}
+
+vector<const RecipeBitmap*> IngredientIndex::postingsFor(const vector<string>& ingredients, bool& unknown) const {
+    vector<const RecipeBitmap*> lists;
+    lists.reserve(ingredients.size());
+    unknown = false;
+    
+    for (const auto& name : ingredients) {
+        int id = ingredientId(name);
+        if (id < 0) {
+            unknown = true;
+            continue;
+        }
+        lists.push_back(&postings_[id]);
+    }
+    
+    sort(lists.begin(), lists.end());
+    lists.erase(unique(lists.begin(), lists.end()), lists.end());
+    return lists;
+}
+
+vector<int> IngredientIndex::matchAll(const vector<string>& ingredients) const {
+    bool unknown;
+    vector<const RecipeBitmap*> lists = postingsFor(ingredients, unknown);
+    if (unknown || lists.empty()) return {};
+    
+    // Начинаем с самого короткого списка, чтобы промежуточные результаты были малы
+    sort(lists.begin(), lists.end(), [](const RecipeBitmap* a, const RecipeBitmap* b) {
+        return a->cardinality() < b->cardinality();
+    });
+    
+    RecipeBitmap result = *lists[0];
+    for (size_t i = 1; i < lists.size() && !result.isEmpty(); ++i) {
+        result = RecipeBitmap::intersect(result, *lists[i]);
+    }
+    
+    vector<int> recipes;
+    recipes.reserve(result.cardinality());
+    result.forEach([&](uint32_t id) { recipes.push_back(static_cast<int>(id)); });
+    return recipes;
+}
+
+vector<int> IngredientIndex::matchAny(const vector<string>& ingredients) const {
+    bool unknown;
+    vector<const RecipeBitmap*> lists = postingsFor(ingredients, unknown);
+    
+    RecipeBitmap result;
+    for (const RecipeBitmap* list : lists) {
+        result = RecipeBitmap::unite(result, *list);
+    }
+    
+    vector<int> recipes;
+    recipes.reserve(result.cardinality());
+    result.forEach([&](uint32_t id) { recipes.push_back(static_cast<int>(id)); });
+    return recipes;
+}
+
+vector<IngredientMatch> IngredientIndex::cookable(const vector<string>& available, int maxMissing) const {
+    bool unknown;
+    vector<const RecipeBitmap*> lists = postingsFor(available, unknown);
+    
+    // Считаем для каждого рецепта, сколько его ингредиентов есть; отдельно
+    // запоминаем затронутые рецепты, чтобы не просматривать весь счетчик
+    vector<uint16_t> matched(ingredientCounts_.size(), 0);
+    vector<int> touched;
+    for (const RecipeBitmap* list : lists) {
+        list->forEach([&](uint32_t id) {
+            if (matched[id]++ == 0) {
+                touched.push_back(static_cast<int>(id));
+            }
+        });
+    }
+    
+    vector<IngredientMatch> result;
+    for (int id : touched) {
+        int missing = ingredientCounts_[id] - matched[id];
+        if (missing <= maxMissing) {
+            result.push_back({id, matched[id], missing});
+        }
+    }
+    
+    // Доля имеющихся matched / (matched + missing) сравнивается без деления
+    sort(result.begin(), result.end(), [](const IngredientMatch& a, const IngredientMatch& b) {
+        long long left = static_cast<long long>(a.matched) * (b.matched + b.missing);
+        long long right = static_cast<long long>(b.matched) * (a.matched + a.missing);
+        if (left != right) return left > right;
+        if (a.missing != b.missing) return a.missing < b.missing;
+        return a.recipeId < b.recipeId;
+    });
+    
+    return result;
+}
\ No newline at end of file
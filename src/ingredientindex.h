@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "recipebitmap.h"
+using namespace std;
+
+class Recipe;
+
+// Рецепт, который можно приготовить из имеющихся продуктов
+struct IngredientMatch {
+    int recipeId;
+    int matched;    // сколько ингредиентов рецепта есть
+    int missing;    // сколько не хватает
+};
+
+// Обратный индекс "ингредиент -> рецепты" для вопроса "что приготовить".
+// Названия сравниваются после foldText; списки рецептов хранятся в RecipeBitmap.
+// Индекс не синхронизирован: изменять и опрашивать его нужно из одного потока
+class IngredientIndex {
+public:
+    void clear();
+    void build(const vector<shared_ptr<Recipe>>& recipes);
+    
+    // Добавляет рецепт или заменяет его ингредиенты
+    void add(const Recipe& recipe);
+    void remove(int recipeId);
+    
+    size_t recipeCount() const { return recipeIngredients_.size(); }
+    
+    // Рецепты, где есть все перечисленные ингредиенты / хотя бы один из них
+    vector<int> matchAll(const vector<string>& ingredients) const;
+    vector<int> matchAny(const vector<string>& ingredients) const;
+    
+    // Рецепты, для которых не хватает не больше maxMissing ингредиентов,
+    // по убыванию доли имеющихся
+    vector<IngredientMatch> cookable(const vector<string>& available, int maxMissing) const;
+
+private:
+    int ingredientId(const string& name) const;
+    vector<const RecipeBitmap*> postingsFor(const vector<string>& ingredients, bool& unknown) const;
+    
+    unordered_map<string, int> ingredientIds_;
+    vector<RecipeBitmap> postings_;                         // по id ингредиента
+    unordered_map<int, vector<int>> recipeIngredients_;     // для замены и удаления
+    vector<uint16_t> ingredientCounts_;                     // по id рецепта
+};
\ No newline at end of file
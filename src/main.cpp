@@ -1,5 +1,6 @@
 #include <QApplication>
 #include "mainwindow.h"
+#include "memoryreciperepository.h"
 #include <iostream>
 #include <QDebug>
 using namespace std;
@@ -25,8 +26,15 @@ int main(int argc, char *argv[]) {
         QApplication app(argc, argv);
         qDebug() << "QApplication создан";
         
+        // --memory: каталог в памяти процесса вместо PostgreSQL, до закрытия окна
+        shared_ptr<RecipeRepository> repository;
+        if (app.arguments().contains("--memory")) {
+            qDebug() << "Хранилище в памяти, без PostgreSQL";
+            repository = make_shared<MemoryRecipeRepository>();
+        }
+        
         qDebug() << "Создание MainWindow...";
-        MainWindow window;
+        MainWindow window(repository);
         qDebug() << "MainWindow создан";
         
         qDebug() << "Показ окна...";
@@ -1,65 +1,268 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "asynccookbookdatabase.h"
 #include "recipedialog.h"
+#include "textfold.h"
 #include <QMessageBox>
 #include <QDebug>
 #include <QTimer>
+#include <QInputDialog>
+#include <QMenu>
+#include <QDir>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <algorithm>
+#include <cctype>
 using namespace std;
-MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent), ui(new Ui::MainWindow) {
+
+// Сколько лучших совпадений показывает полнотекстовый поиск
+static const int SEARCH_RESULT_LIMIT = 200;
+// Поиск запускается после паузы в наборе, а не на каждую нажатую клавишу
+static const int SEARCH_DEBOUNCE_MS = 250;
+// Сколько ингредиентов может не хватать рецепту в ответе "что приготовить"
+static const int COOKABLE_MAX_MISSING = 2;
+static const int COOKABLE_RESULT_LIMIT = 200;
+// Уведомления одной транзакции приходят подряд — ждем, пока соберутся все
+static const int REMOTE_CHANGE_DELAY_MS = 100;
+// Больше стольких измененных рецептов список проще перечитать, чем запрашивать по одному
+static const size_t REMOTE_CHANGE_RELOAD_LIMIT = 50;
+// Сколько последних просмотренных рецептов держать в памяти целиком
+static const size_t RECIPE_CACHE_CAPACITY = 256;
+// Без сервера подключение повторяется со снимком на экране, паузы растут вдвое
+static const int CONNECT_RETRY_FIRST_MS = 2000;
+static const int CONNECT_RETRY_MAX_MS = 60000;
+
+// Новый текст только добавляет слова к прошлому, поэтому найденное им — подмножество
+// прошлой выдачи. Продолжение последнего слова не в счет: после стемминга его
+// основа может оказаться короче и совпасть с тем, что прошлый запрос отсеял
+static bool narrowsSearch(const string& previous, const string& next) {
+    if (previous.empty() || next.size() <= previous.size()) return false;
+    if (next.compare(0, previous.size(), previous) != 0) return false;
+    
+    auto isWordByte = [](char c) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        return byte >= 0x80 || isalnum(byte);
+    };
+    return !isWordByte(previous.back()) || !isWordByte(next[previous.size()]);
+}
+
+MainWindow::MainWindow(shared_ptr<RecipeRepository> repository, QWidget *parent)
+    : QMainWindow(parent), ui(new Ui::MainWindow), repository(move(repository)), databaseReady(false), connectRetryDelay(CONNECT_RETRY_FIRST_MS),
+      asyncDatabase(nullptr), writePool(nullptr), selectedRecipeId(-1), recipesLoadId(0),
+      searchTimer(nullptr), recipeModel(nullptr), tagMenu(nullptr), matchAnyTagAction(nullptr), catalogIndexReady(false),
+      remoteChangeTimer(nullptr), remoteTagsChanged(false), changeFeedConnected(false) {
     
     ui->setupUi(this);
     
-    qDebug() << "Запуск Кулинарной книги...";
-    
-    database = make_unique<CookBookDatabase>();
-    
-    if (!database->connect()) {
-        QString errorMsg = QString("Не удалось подключиться к базе данных:\n%1\n\n"
-                                 "Проверьте что PostgreSQL запущен в контейнере.")
-            .arg(QString::fromStdString(database->getLastError()));
-        
-        QMessageBox::critical(this, "Ошибка", errorMsg);
-        QTimer::singleShot(0, this, &QWidget::close);
-        return;
-    }
+    // Меню тегов: можно отметить несколько, по умолчанию нужны все отмеченные
+    tagMenu = new QMenu(this);
+    ui->tagFilterButton->setMenu(tagMenu);
+    matchAnyTagAction = new QAction("Любой из отмеченных", this);
+    matchAnyTagAction->setCheckable(true);
+    connect(matchAnyTagAction, &QAction::toggled, this, &MainWindow::onTagFilterChanged);
     
-    qDebug() << "База данных подключена!";
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(SEARCH_DEBOUNCE_MS);
+    connect(searchTimer, &QTimer::timeout, this, &MainWindow::applyFilters);
     
-    // Загружаем рецепты
-    loadRecipes();
+    remoteChangeTimer = new QTimer(this);
+    remoteChangeTimer->setSingleShot(true);
+    remoteChangeTimer->setInterval(REMOTE_CHANGE_DELAY_MS);
+    connect(remoteChangeTimer, &QTimer::timeout, this, &MainWindow::applyRemoteChanges);
     
-    // Загружаем теги в комбобокс фильтра
-    loadTags();
+    qDebug() << "Запуск Кулинарной книги...";
     
-    // Если нет рецептов, создаем демо-рецепт
-    if (ui->recipesListWidget->count() == 0) {
-        createDefaultRecipes();
-        loadRecipes();
-        loadTags(); // Перезагружаем теги после создания демо-рецептов
+    if (this->repository) {
+        // Переданное хранилище читается в фоновом потоке, окно его не ждет
+        asyncDatabase = new AsyncRepositoryAdapter(this->repository, this);
+    } else {
+        // Запись идет через пул соединений; первое соединение проверяет схему.
+        // Пул и асинхронное соединение делят кэш рецептов: повторный просмотр
+        // и открытие редактора не обращаются к серверу
+        recipeCache = make_shared<RecipeCache>(RECIPE_CACHE_CAPACITY);
+        databasePool = make_unique<CookBookDatabasePool>(4, recipeCache);
+        
+        // Чтение идет через отдельное неблокирующее соединение, окно не ждет БД
+        auto database = new AsyncCookBookDatabase(this);
+        database->setRecipeCache(recipeCache);
+        asyncDatabase = database;
     }
+    // Запись ждет свободное соединение пула и сервер, поэтому идет в фоне;
+    // один поток сохраняет порядок записей
+    writePool = new QThreadPool(this);
+    writePool->setMaxThreadCount(1);
+    
+    connect(asyncDatabase, &AsyncRecipeRepository::errorOccurred, this, [this](const QString& message) {
+        ui->statusbar->showMessage(QString("Ошибка БД: %1").arg(message.trimmed()));
+    });
+    // Чужие записи приходят уведомлениями; пропущенные за время обрыва не придут,
+    // поэтому после переподключения все перечитывается
+    connect(asyncDatabase, &AsyncRecipeRepository::changeNotified, this, &MainWindow::onChangeNotified);
+    connect(asyncDatabase, &AsyncRecipeRepository::connected, this, [this]() {
+        if (changeFeedConnected) {
+            resyncAfterReconnect();
+        }
+        changeFeedConnected = true;
+    });
+    
+    // Список показывает модель, строки подгружаются страницами по мере прокрутки
+    recipeModel = new RecipeListModel(asyncDatabase, this);
+    ui->recipesListView->setModel(recipeModel);
+    connect(recipeModel, &RecipeListModel::pageLoaded, this, &MainWindow::showListStatus);
     
     // Подключаем сигналы
     connect(ui->addButton, &QPushButton::clicked, this, &MainWindow::onAddRecipeClicked);
     connect(ui->editButton, &QPushButton::clicked, this, &MainWindow::onEditRecipeClicked);
     connect(ui->deleteButton, &QPushButton::clicked, this, &MainWindow::onDeleteRecipeClicked);
-    connect(ui->recipesListWidget, &QListWidget::itemClicked, this, &MainWindow::onRecipeSelected);
+    connect(ui->recipesListView, &QListView::clicked, this, &MainWindow::onRecipeSelected);
+    connect(ui->cookableButton, &QPushButton::clicked, this, &MainWindow::onCookableClicked);
     connect(ui->searchEdit, &QLineEdit::textChanged, this, &MainWindow::onSearchTextChanged);
-    connect(ui->tagFilterComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onTagFilterChanged);
     
-    // Выбираем первый рецепт если есть
-    if (ui->recipesListWidget->count() > 0) {
-        ui->recipesListWidget->setCurrentRow(0);
-        onRecipeSelected(ui->recipesListWidget->item(0));
+    // Переданное хранилище уже открыто: ни снимка, ни подключения не нужно
+    if (this->repository) {
+        onDatabaseReady(true, QString());
+        return;
+    }
+    
+    // Сохраненный каталог открывается без разбора, список виден сразу
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(cacheDir);
+    snapshotPath = (cacheDir + "/catalog.snapshot").toStdString();
+    if (snapshot.open(snapshotPath)) {
+        vector<string> tags;
+        tags.reserve(snapshot.tagCount());
+        for (size_t tag = 0; tag < snapshot.tagCount(); ++tag) {
+            tags.emplace_back(snapshot.tagName(tag));
+        }
+        setTagMenu(tags);
+        showSnapshot(true);
     }
     
-    ui->statusbar->showMessage("Готово");
+    // Окно показывается сразу, а подключение и проверка схемы идут в фоне:
+    // первое соединение пула может ждать сервер и выполнять миграции.
+    // До готовности базы элементы, которые к ней обращаются, недоступны
+    setDatabaseControlsEnabled(false);
+    ui->statusbar->showMessage("Подключение к базе данных...");
+    startConnect();
+}
+
+void MainWindow::startConnect() {
+    // Прошлая попытка уже сообщила результат, ее поток завершается
+    if (connectThread.joinable()) {
+        connectThread.join();
+    }
+    
+    connectThread = thread([this]() {
+        bool ok = static_cast<bool>(databasePool->acquire());
+        QString error = ok ? QString() : QString::fromStdString(databasePool->getLastError());
+        QMetaObject::invokeMethod(this, [this, ok, error]() { onDatabaseReady(ok, error); }, Qt::QueuedConnection);
+    });
+}
+
+MainWindow::RepositoryHandle MainWindow::acquireRepository() {
+    if (repository) {
+        return RepositoryHandle(repository.get());
+    }
+    return databasePool->acquire();
+}
+
+void MainWindow::runWrite(function<bool(RecipeRepository&, RecipeChange&)> write,
+                          function<void(bool, const RecipeChange&)> done) {
+    writePool->start([this, write, done]() {
+        RecipeChange change;
+        bool ok = false;
+        {
+            auto database = acquireRepository();
+            ok = database && write(*database, change);
+        }
+        QMetaObject::invokeMethod(this, [done, ok, change]() { done(ok, change); }, Qt::QueuedConnection);
+    });
 }
 
 MainWindow::~MainWindow() {
+    // Подключение ограничено connect_timeout, окно ждет его завершения;
+    // начатые записи тоже доводятся до конца, их ответы уже никто не ждет
+    writePool->waitForDone();
+    if (connectThread.joinable()) {
+        connectThread.join();
+    }
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+    
+    if (recipeCache) {
+        RecipeCache::Stats stats = recipeCache->stats();
+        qDebug() << "Кэш рецептов: попаданий" << stats.hits << "со сверкой версии" << stats.checks
+                 << "промахов" << stats.misses << "вытеснено" << stats.evictions;
+    }
     delete ui;
 }
 
+void MainWindow::onDatabaseReady(bool ok, const QString& error) {
+    if (connectThread.joinable()) {
+        connectThread.join();
+    }
+    
+    if (!ok && snapshot.isOpen()) {
+        // Без сервера остается сохраненный каталог: его можно листать и искать,
+        // а подключение повторяется, пока сервер не ответит
+        qDebug() << "База данных недоступна:" << error;
+        ui->statusbar->showMessage(QString("Нет связи с базой данных, показан сохраненный каталог. "
+                                           "Повтор через %1 с").arg(connectRetryDelay / 1000));
+        QTimer::singleShot(connectRetryDelay, this, &MainWindow::startConnect);
+        connectRetryDelay = min(connectRetryDelay * 2, CONNECT_RETRY_MAX_MS);
+        return;
+    }
+    
+    if (!ok) {
+        QString errorMsg = QString("Не удалось подключиться к базе данных:\n%1\n\n"
+                                 "Проверьте что PostgreSQL запущен в контейнере.").arg(error);
+        
+        QMessageBox::critical(this, "Ошибка", errorMsg);
+        close();
+        return;
+    }
+    
+    qDebug() << "База данных подключена!";
+    
+    // Схема проверена — асинхронное соединение может готовить свои запросы
+    databaseReady = true;
+    asyncDatabase->connectToServer();
+    setDatabaseControlsEnabled(true);
+    ui->statusbar->showMessage("Загрузка рецептов...");
+    
+    // Загружаем первую страницу и выбираем первый рецепт, если из снимка еще
+    // ничего не выбрано; если рецептов нет, создаем демо-рецепт
+    loadRecipes(selectedRecipeId < 0, true);
+    
+    // Загружаем теги в меню фильтра
+    loadTags();
+    
+    // Снимок сверяется через свое соединение пула, очередь чтения окна не ждет.
+    // Переданному хранилищу снимок не нужен
+    if (!databasePool) return;
+    
+    syncThread = thread([this]() {
+        auto database = databasePool->acquire();
+        if (!database) return;
+        
+        if (!syncRecipeSnapshot(*database, snapshot, snapshotPath)) {
+            qDebug() << "Не удалось обновить снимок каталога:" << QString::fromStdString(database->getLastError());
+        }
+    });
+}
+
+void MainWindow::setDatabaseControlsEnabled(bool enabled) {
+    ui->addButton->setEnabled(enabled);
+    ui->editButton->setEnabled(enabled);
+    ui->deleteButton->setEnabled(enabled);
+    ui->cookableButton->setEnabled(enabled);
+    // Поиск и теги работают и по снимку каталога
+    ui->searchEdit->setEnabled(enabled || snapshot.isOpen());
+    ui->tagFilterButton->setEnabled(enabled || snapshot.isOpen());
+}
+
 void MainWindow::createDefaultRecipes() {
     qDebug() << "Создание демо-рецептов...";
     
@@ -75,156 +278,532 @@ void MainWindow::createDefaultRecipes() {
     demo.addTag("демо");
     demo.addTag("инструкция");
     
-    database->addRecipe(demo);
+    // Рецепт и его теги добавляются в список и меню на месте, без перечитывания
+    runWrite([demo](RecipeRepository& database, RecipeChange& change) mutable {
+        return database.addRecipe(demo, &change) != -1;
+    }, [this](bool ok, const RecipeChange& change) {
+        if (ok) {
+            applyRecipeChange(change);
+        }
+    });
 }
 
-void MainWindow::loadRecipes() {
-    ui->recipesListWidget->clear();
+void MainWindow::loadRecipes(bool selectFirst, bool createDemoIfEmpty) {
+    // Ответы предыдущей, еще не завершенной загрузки отбрасываются; сам список
+    // остается на экране, пока не придет первая порция новой загрузки
+    int loadId = ++recipesLoadId;
+    
+    // До подключения к базе список берется из снимка
+    if (!databaseReady) {
+        showSnapshot(selectFirst);
+        return;
+    }
+    
+    // Поисковый запрос показывает лучшие совпадения по релевантности
+    if (!recipeSearch.empty()) {
+        showSearchResults(selectFirst);
+        return;
+    }
     
-    auto recipes = database->getAllRecipes();
+    // Список подгружается страницами по мере прокрутки; теги отбирает сервер,
+    // чтобы в памяти были только подходящие строки
+    RecipeFilter filter;
+    if (tagMode() == TagIndex::MatchAll) {
+        filter.tags = selectedTags;
+    } else {
+        filter.anyTags = selectedTags;
+    }
     
-    for (const auto& recipe : recipes) {
-        QListWidgetItem* item = new QListWidgetItem(
-            QString::fromStdString(recipe->getName()));
-        item->setData(Qt::UserRole, recipe->getId());
+    recipeModel->loadPages(filter, [this, loadId, selectFirst, createDemoIfEmpty](bool ok) {
+        if (loadId != recipesLoadId) return;
         
-        // Сохраняем теги рецепта в данных элемента
-        QStringList tags;
-        for (const auto& tag : recipe->getTags()) {
-            tags << QString::fromStdString(tag);
+        if (ok && createDemoIfEmpty && recipeModel->rowCount() == 0 && !recipeModel->hasMore()) {
+            createDefaultRecipes();
         }
-        item->setData(Qt::UserRole + 1, tags);
         
-        ui->recipesListWidget->addItem(item);
+        if (selectFirst) {
+            selectFirstVisible();
+        }
+    });
+}
+
+void MainWindow::showSnapshot(bool selectFirst) {
+    // Без сервера нет полнотекстового поиска — ищем подстроку в названии.
+    // Модель читает строки из снимка страницами по мере прокрутки
+    int loadId = recipesLoadId;
+    recipeModel->loadSnapshot(&snapshot, foldText(recipeSearch), selectedTags, tagMode(),
+                              [this, loadId, selectFirst](bool) {
+        if (loadId != recipesLoadId) return;
+        
+        if (selectFirst) {
+            selectFirstVisible();
+        }
+    });
+}
+
+void MainWindow::showSearchResults(bool selectFirst) {
+    int loadId = recipesLoadId;
+    // Для "всех тегов" сервер отбирает совпадения сразу с нужными тегами
+    vector<string> tags = tagMode() == TagIndex::MatchAll ? selectedTags : vector<string>();
+    
+    vector<int> within;
+    if (narrowsSearch(narrowableSearch, recipeSearch)) {
+        // Прошлый поиск ничего не нашел — новые слова тоже ничего не найдут
+        if (narrowableIds.empty()) {
+            showFuzzyResults(selectFirst);
+            return;
+        }
+        within = narrowableIds;
     }
     
-    ui->statusbar->showMessage(QString("Рецептов: %1").arg(recipes.size()));
+    string search = recipeSearch;
+    asyncDatabase->searchRecipes(recipeSearch, tags, SEARCH_RESULT_LIMIT, within, this,
+                                 [this, loadId, selectFirst, search](vector<RecipeSearchResult> results) {
+        if (loadId != recipesLoadId) return;
+        
+        // Выдача короче лимита содержит все совпадения — ее можно сужать дальше
+        narrowableSearch.clear();
+        narrowableIds.clear();
+        if (results.size() < static_cast<size_t>(SEARCH_RESULT_LIMIT)) {
+            narrowableSearch = search;
+            for (const auto& result : results) {
+                narrowableIds.push_back(result.id);
+            }
+        }
+        
+        // Полнотекстовый поиск не прощает опечаток — тогда ищем похожие названия
+        if (results.empty()) {
+            showFuzzyResults(selectFirst);
+            return;
+        }
+        
+        vector<RecipeListEntry> entries;
+        entries.reserve(results.size());
+        for (auto& result : results) {
+            // Фрагменты с найденными словами показываются в подсказке
+            entries.push_back({result.id, move(result.name), move(result.tags), move(result.snippet)});
+        }
+        recipeModel->setRecipes(entries);
+        
+        ui->statusbar->showMessage(QString("Найдено рецептов: %1").arg(results.size()));
+        applyTagFilter();
+        
+        if (selectFirst) {
+            selectFirstVisible();
+        }
+    });
+}
+
+void MainWindow::showFuzzyResults(bool selectFirst) {
+    int loadId = recipesLoadId;
+    loadCatalogIndexes([this, loadId, selectFirst]() {
+        if (loadId != recipesLoadId) return;
+        
+        vector<FuzzyMatch> matches = trigramIndex.search(recipeSearch, SEARCH_RESULT_LIMIT);
+        vector<RecipeListEntry> entries;
+        entries.reserve(matches.size());
+        for (const auto& match : matches) {
+            const IndexedRecipe& recipe = indexedRecipes[match.recipeId];
+            QString toolTip = QString("Похожее название (%1%)").arg(qRound(match.similarity * 100));
+            entries.push_back({match.recipeId, recipe.name, recipe.tags, toolTip.toStdString()});
+        }
+        recipeModel->setRecipes(entries);
+        
+        ui->statusbar->showMessage(matches.empty()
+            ? QString("Ничего не найдено")
+            : QString("Точных совпадений нет, похожих рецептов: %1").arg(matches.size()));
+        applyTagFilter();
+        
+        if (selectFirst) {
+            selectFirstVisible();
+        }
+    });
+}
+
+void MainWindow::onCookableClicked() {
+    bool ok = false;
+    QString text = QInputDialog::getText(this, "Что приготовить?", "Продукты через запятую:",
+                                         QLineEdit::Normal, availableIngredients, &ok);
+    if (!ok || text.trimmed().isEmpty()) return;
+    availableIngredients = text;
+    
+    vector<string> available;
+    for (const QString& name : text.split(',', Qt::SkipEmptyParts)) {
+        if (!name.trimmed().isEmpty()) {
+            available.push_back(name.trimmed().toStdString());
+        }
+    }
+    
+    loadCatalogIndexes([this, available]() { showCookable(available); });
+}
+
+void MainWindow::showCookable(const vector<string>& available) {
+    ++recipesLoadId;
+    
+    vector<IngredientMatch> matches = ingredientIndex.cookable(available, COOKABLE_MAX_MISSING);
+    if (matches.size() > static_cast<size_t>(COOKABLE_RESULT_LIMIT)) {
+        matches.resize(COOKABLE_RESULT_LIMIT);
+    }
+    
+    vector<RecipeListEntry> entries;
+    entries.reserve(matches.size());
+    for (const auto& match : matches) {
+        const IndexedRecipe& recipe = indexedRecipes[match.recipeId];
+        QString toolTip = match.missing == 0
+            ? QString("Есть все ингредиенты")
+            : QString("Не хватает ингредиентов: %1").arg(match.missing);
+        entries.push_back({match.recipeId, recipe.name, recipe.tags, toolTip.toStdString()});
+    }
+    recipeModel->setRecipes(entries);
+    
+    ui->statusbar->showMessage(QString("Можно приготовить: %1").arg(matches.size()));
+    applyTagFilter();
+}
+
+void MainWindow::loadCatalogIndexes(function<void()> ready) {
+    if (catalogIndexReady) {
+        ready();
+        return;
+    }
+    
+    // Индексы строятся один раз из общей выгрузки, дальше обновляются при записи
+    ui->statusbar->showMessage("Построение индекса рецептов...");
+    asyncDatabase->getAllRecipes(RecipeIngredients | RecipeTags, this, [this, ready](vector<shared_ptr<Recipe>> recipes) {
+        if (!catalogIndexReady) {
+            ingredientIndex.build(recipes);
+            trigramIndex.clear();
+            indexedRecipes.clear();
+            indexedRecipes.reserve(recipes.size());
+            for (const auto& recipe : recipes) {
+                trigramIndex.add(*recipe);
+                indexedRecipes[recipe->getId()] = {recipe->getName(), recipe->getTags()};
+            }
+            catalogIndexReady = true;
+        }
+        
+        ready();
+    });
+}
+
+void MainWindow::indexRecipe(const Recipe& recipe) {
+    if (!catalogIndexReady) return;
+    
+    ingredientIndex.add(recipe);
+    trigramIndex.add(recipe);
+    indexedRecipes[recipe.getId()] = {recipe.getName(), recipe.getTags()};
+}
+
+void MainWindow::selectFirstVisible() {
+    if (recipeModel->rowCount() == 0) return;
+    
+    QModelIndex first = recipeModel->index(0);
+    ui->recipesListView->setCurrentIndex(first);
+    onRecipeSelected(first);
+}
+
+void MainWindow::applyRecipeChange(const RecipeChange& change) {
+    // Записанный рецепт мог начать или перестать совпадать с прошлым поиском
+    narrowableSearch.clear();
+    
+    // Строка меняется на своем месте в списке; если новый рецепт некуда поставить
+    // в выдаче поиска или строка не нашлась по ключу, список перезапрашиваем
+    if (!recipeModel->applyChange(change)) {
+        loadRecipes();
+    }
+    
+    for (const auto& tag : change.createdTags) {
+        insertTagAction(tag);
+    }
+}
+
+QAction* MainWindow::createTagAction(const string& tag, bool checked) {
+    QAction* action = new QAction(QString::fromStdString(tag), tagMenu);
+    action->setCheckable(true);
+    action->setChecked(checked);
+    connect(action, &QAction::toggled, this, &MainWindow::onTagFilterChanged);
+    return action;
+}
+
+void MainWindow::insertTagAction(const string& tag) {
+    // Теги в меню идут после переключателя режима и разделителя, по имени побайтово,
+    // как их отдает сервер
+    QList<QAction*> actions = tagMenu->actions();
+    auto first = actions.begin() + min<qsizetype>(2, actions.size());
+    auto it = lower_bound(first, actions.end(), tag, [](QAction* action, const string& name) {
+        return action->text().toStdString() < name;
+    });
+    
+    if (it != actions.end() && (*it)->text().toStdString() == tag) return;
+    tagMenu->insertAction(it != actions.end() ? *it : nullptr, createTagAction(tag));
 }
 
 void MainWindow::loadTags() {
-    ui->tagFilterComboBox->clear();
-    ui->tagFilterComboBox->addItem("Все теги", "");
+    asyncDatabase->getAllTags(this, [this](vector<string> tags) { setTagMenu(tags); });
+}
+
+void MainWindow::setTagMenu(const vector<string>& tags) {
+    // Отметки сохраняются; фильтр пересчитывается, только если пропал отмеченный тег
+    tagMenu->clear();
+    tagMenu->addAction(matchAnyTagAction);
+    tagMenu->addSeparator();
     
-    auto tags = database->getAllTags();
+    size_t kept = 0;
     for (const auto& tag : tags) {
-        ui->tagFilterComboBox->addItem(QString::fromStdString(tag), 
-                                       QString::fromStdString(tag));
+        bool checked = find(selectedTags.begin(), selectedTags.end(), tag) != selectedTags.end();
+        tagMenu->addAction(createTagAction(tag, checked));
+        if (checked) {
+            ++kept;
+        }
+    }
+    
+    if (kept != selectedTags.size()) {
+        onTagFilterChanged();
     }
 }
 
-void MainWindow::onAddRecipeClicked() {
-    RecipeDialog dialog(database.get(), RecipeDialog::Create, this);
+void MainWindow::onChangeNotified(const ChangeNotification& notification) {
+    // Свои записи уже применены к списку по RecipeChange
+    if (databasePool && databasePool->isOwnBackend(notification.senderPid)) return;
+    
+    switch (notification.kind) {
+    case ChangeNotification::TagsChanged:
+        remoteTagsChanged = true;
+        break;
+    case ChangeNotification::RecipeRemoved:
+        remoteChanges[notification.id] = true;
+        break;
+    case ChangeNotification::RecipeChanged:
+        // Удаление важнее: каскад по ингредиентам удаленного рецепта тоже уведомляет
+        remoteChanges.emplace(notification.id, false);
+        break;
+    }
+    
+    if (!remoteChangeTimer->isActive()) {
+        remoteChangeTimer->start();
+    }
+}
+
+void MainWindow::applyRemoteChanges() {
+    unordered_map<int, bool> changes;
+    changes.swap(remoteChanges);
+    bool tagsChanged = remoteTagsChanged;
+    remoteTagsChanged = false;
+    
+    // Чужая запись могла изменить совпадения прошлого поиска
+    narrowableSearch.clear();
     
-    if (dialog.exec() == QDialog::Accepted) {
-        Recipe recipe = dialog.getRecipe();
-        int recipeId = database->addRecipe(recipe);
+    if (tagsChanged) {
+        loadTags();
+    }
+    
+    // Массовый импорт: индексы каталога перестроятся при следующем запросе к ним
+    if (changes.size() > REMOTE_CHANGE_RELOAD_LIMIT) {
+        catalogIndexReady = false;
+        loadRecipes();
+        return;
+    }
+    
+    for (const auto& [recipeId, removed] : changes) {
+        if (removed) {
+            forgetRecipe(recipeId);
+            continue;
+        }
         
-        if (recipeId != -1) {
-            loadRecipes();
-            loadTags(); // Обновляем список тегов
+        int id = recipeId;
+        asyncDatabase->getRecipeById(id, this, [this, id](shared_ptr<Recipe> recipe) {
+            // Рецепт успели удалить; при обрыве соединения список и так перечитается
+            if (!recipe) {
+                forgetRecipe(id);
+                return;
+            }
+            
+            RecipeChange change;
+            change.kind = RecipeChange::Updated;
+            change.id = id;
+            change.name = recipe->getName();
+            change.tags = recipe->getTags();
+            sort(change.tags.begin(), change.tags.end());
+            change.tags.erase(unique(change.tags.begin(), change.tags.end()), change.tags.end());
+            
+            indexRecipe(*recipe);
+            applyRecipeChange(change);
+            
+            if (id == selectedRecipeId) {
+                showRecipe(*recipe);
+            }
+        });
+    }
+}
+
+void MainWindow::resyncAfterReconnect() {
+    remoteChangeTimer->stop();
+    remoteChanges.clear();
+    remoteTagsChanged = false;
+    narrowableSearch.clear();
+    catalogIndexReady = false;
+    
+    loadRecipes();
+    loadTags();
+}
+
+void MainWindow::forgetRecipe(int recipeId) {
+    ingredientIndex.remove(recipeId);
+    trigramIndex.remove(recipeId);
+    indexedRecipes.erase(recipeId);
+    
+    RecipeChange change;
+    change.kind = RecipeChange::Removed;
+    change.id = recipeId;
+    applyRecipeChange(change);
+    
+    if (recipeId == selectedRecipeId) {
+        selectedRecipeId = -1;
+        clearRecipeDetails();
+    }
+}
+
+void MainWindow::clearRecipeDetails() {
+    ui->recipeNameLabel->setText("Кулинарная книга");
+    ui->descriptionLabel->setText("Выберите рецепт из списка");
+    ui->ingredientsTextEdit->clear();
+    ui->stepsTextEdit->clear();
+    ui->categoryLabel->clear();
+    ui->cookingTimeLabel->clear();
+    ui->difficultyLabel->clear();
+    ui->tagsLabel->clear();
+}
+
+void MainWindow::onAddRecipeClicked() {
+    RecipeDialog dialog(asyncDatabase, RecipeDialog::Create, this);
+    
+    if (dialog.exec() != QDialog::Accepted) return;
+    
+    // addRecipe проставляет рецепту id, индексы каталога получают его уже с id
+    auto recipe = make_shared<Recipe>(dialog.getRecipe());
+    runWrite([recipe](RecipeRepository& database, RecipeChange& change) {
+        return database.addRecipe(*recipe, &change) != -1;
+    }, [this, recipe](bool ok, const RecipeChange& change) {
+        if (ok) {
+            indexRecipe(*recipe);
+            applyRecipeChange(change);
             QMessageBox::information(this, "Успех", "Рецепт добавлен!");
         } else {
             QMessageBox::warning(this, "Ошибка", "Не удалось добавить рецепт");
         }
-    }
+    });
 }
 
 void MainWindow::onEditRecipeClicked() {
-    QListWidgetItem* item = ui->recipesListWidget->currentItem();
-    if (!item) {
+    int recipeId = recipeModel->recipeId(ui->recipesListView->currentIndex());
+    if (recipeId < 0) {
         QMessageBox::warning(this, "Предупреждение", "Выберите рецепт для редактирования");
         return;
     }
     
-    int recipeId = item->data(Qt::UserRole).toInt();
-    auto recipe = database->getRecipeById(recipeId);
-    
-    if (!recipe) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось загрузить рецепт");
-        return;
-    }
-    
-    RecipeDialog dialog(database.get(), RecipeDialog::Edit, this);
-    dialog.setRecipe(*recipe);
-    
-    if (dialog.exec() == QDialog::Accepted) {
-        Recipe updatedRecipe = dialog.getRecipe();
-        if (database->updateRecipe(updatedRecipe)) {
-            item->setText(QString::fromStdString(updatedRecipe.getName()));
-            
-            // Обновляем теги в данных элемента
-            QStringList tags;
-            for (const auto& tag : updatedRecipe.getTags()) {
-                tags << QString::fromStdString(tag);
+    asyncDatabase->getRecipeById(recipeId, this, [this](shared_ptr<Recipe> recipe) {
+        if (!recipe) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось загрузить рецепт");
+            return;
+        }
+        
+        // Диалог открывается из цикла событий, а не внутри разбора ответа:
+        // его собственный цикл событий не должен вклиниваться в очередь запросов
+        QMetaObject::invokeMethod(this, [this, recipe]() { editRecipe(*recipe); }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::editRecipe(const Recipe& recipe) {
+    RecipeDialog dialog(asyncDatabase, RecipeDialog::Edit, this);
+    dialog.setRecipe(recipe);
+    
+    if (dialog.exec() != QDialog::Accepted) return;
+    
+    auto updatedRecipe = make_shared<Recipe>(dialog.getRecipe());
+    runWrite([updatedRecipe](RecipeRepository& database, RecipeChange& change) {
+        return database.updateRecipe(*updatedRecipe, &change);
+    }, [this, updatedRecipe](bool ok, const RecipeChange& change) {
+        if (ok) {
+            indexRecipe(*updatedRecipe);
+            applyRecipeChange(change);
+            // Пока шла запись, пользователь мог выбрать другой рецепт
+            if (updatedRecipe->getId() == selectedRecipeId) {
+                showRecipe(*updatedRecipe);
             }
-            item->setData(Qt::UserRole + 1, tags);
-            
-            loadTags(); // Обновляем список тегов
-            onRecipeSelected(item);
             QMessageBox::information(this, "Успех", "Рецепт обновлен!");
         } else {
             QMessageBox::warning(this, "Ошибка", "Не удалось обновить рецепт");
         }
-    }
+    });
 }
 
 void MainWindow::onDeleteRecipeClicked() {
-    QListWidgetItem* item = ui->recipesListWidget->currentItem();
-    if (!item) {
+    QModelIndex current = ui->recipesListView->currentIndex();
+    int recipeId = recipeModel->recipeId(current);
+    if (recipeId < 0) {
         QMessageBox::warning(this, "Предупреждение", "Выберите рецепт для удаления");
         return;
     }
     
-    int recipeId = item->data(Qt::UserRole).toInt();
-    QString recipeName = item->text();
+    QString recipeName = current.data().toString();
     
     QMessageBox::StandardButton reply;
     reply = QMessageBox::question(this, "Удаление", 
         QString("Удалить рецепт '%1'?").arg(recipeName),
         QMessageBox::Yes | QMessageBox::No);
     
-    if (reply == QMessageBox::Yes) {
-        if (database->deleteRecipe(recipeId)) {
-            delete item;
-            // Очищаем отображение
-            ui->recipeNameLabel->setText("Кулинарная книга");
-            ui->descriptionLabel->setText("Выберите рецепт из списка");
-            ui->ingredientsTextEdit->clear();
-            ui->stepsTextEdit->clear();
-            ui->categoryLabel->clear();
-            ui->cookingTimeLabel->clear();
-            ui->difficultyLabel->clear();
-            ui->tagsLabel->clear();
+    if (reply != QMessageBox::Yes) return;
+    
+    runWrite([recipeId](RecipeRepository& database, RecipeChange&) {
+        return database.deleteRecipe(recipeId);
+    }, [this, recipeId](bool ok, const RecipeChange&) {
+        if (ok) {
+            forgetRecipe(recipeId);
             
-            loadTags(); // Обновляем список тегов
             QMessageBox::information(this, "Успех", "Рецепт удален!");
         } else {
             QMessageBox::warning(this, "Ошибка", "Не удалось удалить рецепт");
         }
-    }
+    });
 }
 
-void MainWindow::onRecipeSelected(QListWidgetItem* item) {
-    if (!item) return;
+void MainWindow::onRecipeSelected(const QModelIndex& index) {
+    int recipeId = recipeModel->recipeId(index);
+    if (recipeId < 0) return;
     
-    int recipeId = item->data(Qt::UserRole).toInt();
-    auto recipe = database->getRecipeById(recipeId);
+    selectedRecipeId = recipeId;
     
-    if (!recipe) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось загрузить рецепт");
+    if (!databaseReady) {
+        long row = snapshot.rowOf(recipeId);
+        if (row >= 0) {
+            showRecipe(snapshot.recipe(row));
+        }
         return;
     }
     
+    asyncDatabase->getRecipeById(recipeId, this, [this, recipeId](shared_ptr<Recipe> recipe) {
+        // Пока шел запрос, пользователь мог выбрать другой рецепт
+        if (recipeId != selectedRecipeId) return;
+        
+        if (!recipe) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось загрузить рецепт");
+            return;
+        }
+        
+        showRecipe(*recipe);
+    });
+}
+
+void MainWindow::showRecipe(const Recipe& recipe) {
     // Отображаем рецепт
-    ui->recipeNameLabel->setText(QString::fromStdString(recipe->getName()));
-    ui->descriptionLabel->setText(QString::fromStdString(recipe->getDescription()));
-    ui->categoryLabel->setText(QString("Категория: %1").arg(QString::fromStdString(recipe->getCategory())));
-    ui->cookingTimeLabel->setText(QString("Время: %1 мин").arg(recipe->getCookingTime()));
-    ui->difficultyLabel->setText(QString("Сложность: %1").arg(QString::fromStdString(recipe->getDifficulty())));
+    ui->recipeNameLabel->setText(QString::fromStdString(recipe.getName()));
+    ui->descriptionLabel->setText(QString::fromStdString(recipe.getDescription()));
+    ui->categoryLabel->setText(QString("Категория: %1").arg(QString::fromStdString(recipe.getCategory())));
+    ui->cookingTimeLabel->setText(QString("Время: %1 мин").arg(recipe.getCookingTime()));
+    ui->difficultyLabel->setText(QString("Сложность: %1").arg(QString::fromStdString(recipe.getDifficulty())));
     
     // Теги
     QString tagsText;
-    auto tags = recipe->getTags();
+    auto tags = recipe.getTags();
     for (const auto& tag : tags) {
         tagsText += QString("#%1 ").arg(QString::fromStdString(tag));
     }
@@ -232,7 +811,7 @@ void MainWindow::onRecipeSelected(QListWidgetItem* item) {
     
     // Ингредиенты
     QString ingredients;
-    for (const auto& ing : recipe->getIngredients()) {
+    for (const auto& ing : recipe.getIngredients()) {
         ingredients += QString("• %1 - %2 %3\n")
             .arg(QString::fromStdString(ing.getName()))
             .arg(QString::fromStdString(ing.getQuantity()))
@@ -243,7 +822,7 @@ void MainWindow::onRecipeSelected(QListWidgetItem* item) {
     // Шаги
     QString steps;
     int stepNumber = 1;
-    for (const auto& step : recipe->getSteps()) {
+    for (const auto& step : recipe.getSteps()) {
         steps += QString("<b>Шаг %1:</b> %2<br><br>")
             .arg(stepNumber)
             .arg(QString::fromStdString(step.getDescription()));
@@ -253,43 +832,74 @@ void MainWindow::onRecipeSelected(QListWidgetItem* item) {
 }
 
 void MainWindow::onSearchTextChanged(const QString& text) {
-    applyFilters();
+    // Каждая клавиша откладывает поиск; запрос уходит, когда набор затих
+    searchTimer->start();
 }
 
-void MainWindow::onTagFilterChanged(int index) {
-    applyFilters();
+void MainWindow::onTagFilterChanged() {
+    selectedTags.clear();
+    for (QAction* action : tagMenu->actions()) {
+        if (action != matchAnyTagAction && action->isChecked()) {
+            selectedTags.push_back(action->text().toStdString());
+        }
+    }
+    
+    ui->tagFilterButton->setText(selectedTags.empty()
+        ? QString("Теги")
+        : QString("Теги (%1)").arg(selectedTags.size()));
+    
+    // Загруженные строки фильтруются сразу; поиск и постраничный список
+    // отбираются на сервере — их перезапрашиваем
+    narrowableSearch.clear();
+    applyTagFilter();
+    
+    if (!recipeSearch.empty() || recipeModel->isPaged()) {
+        loadRecipes();
+    }
 }
 
-void MainWindow::applyFilters() {
-    QString searchText = ui->searchEdit->text();
-    QString selectedTag = ui->tagFilterComboBox->currentData().toString();
+TagIndex::Mode MainWindow::tagMode() const {
+    return matchAnyTagAction->isChecked() ? TagIndex::MatchAny : TagIndex::MatchAll;
+}
+
+void MainWindow::applyTagFilter() {
+    // Маска считается по индексу модели, представление получает только итоговые строки
+    recipeModel->setTagFilter(selectedTags, tagMode());
     
-    for (int i = 0; i < ui->recipesListWidget->count(); ++i) {
-        QListWidgetItem* item = ui->recipesListWidget->item(i);
-        
-        bool matchesSearch = item->text().contains(searchText, Qt::CaseInsensitive);
-        bool matchesTag = true;
-        
-        if (!selectedTag.isEmpty()) {
-            // Проверяем, содержит ли рецепт выбранный тег
-            QStringList tags = item->data(Qt::UserRole + 1).toStringList();
-            matchesTag = tags.contains(selectedTag);
-        }
-        
-        item->setHidden(!(matchesSearch && matchesTag));
+    if (!selectedTags.empty()) {
+        showListStatus();
     }
+}
+
+void MainWindow::showListStatus() {
+    // Пока список не докручен до конца, общее число рецептов неизвестно
+    QString count = QString::number(recipeModel->rowCount()) + (recipeModel->hasMore() ? "+" : "");
     
-    // Обновляем статус
-    int visibleCount = 0;
-    for (int i = 0; i < ui->recipesListWidget->count(); ++i) {
-        if (!ui->recipesListWidget->item(i)->isHidden()) {
-            visibleCount++;
-        }
+    if (selectedTags.empty()) {
+        ui->statusbar->showMessage(QString("Рецептов: %1").arg(count));
+        return;
     }
     
-    if (!selectedTag.isEmpty()) {
-        ui->statusbar->showMessage(QString("Рецептов с тегом '%1': %2").arg(selectedTag).arg(visibleCount));
-    } else {
-        ui->statusbar->showMessage(QString("Показано рецептов: %1").arg(visibleCount));
+    QStringList tags;
+    for (const auto& tag : selectedTags) {
+        tags << QString::fromStdString(tag);
     }
+    ui->statusbar->showMessage(QString("Рецептов с тегами '%1': %2")
+        .arg(tags.join(tagMode() == TagIndex::MatchAll ? " и " : " или "))
+        .arg(count));
+}
+
+void MainWindow::applyFilters() {
+    searchTimer->stop();
+    
+    // Текст ищется на сервере полнотекстовым поиском по названию, описанию,
+    // ингредиентам и шагам; теги фильтруются по индексу уже загруженного списка
+    string search = ui->searchEdit->text().trimmed().toStdString();
+    if (search != recipeSearch) {
+        recipeSearch = search;
+        loadRecipes();
+        return;
+    }
+    
+    applyTagFilter();
 }
\ No newline at end of file
@@ -1,9 +1,19 @@
 #pragma once
 #include <QMainWindow>
 #include <memory>
-#include <QListWidgetItem>
-#include "cookbookdatabase.h"
+#include <thread>
+#include "cookbookdatabasepool.h"
+#include "asyncreciperepository.h"
+#include "ingredientindex.h"
+#include "recipecache.h"
+#include "recipelistmodel.h"
+#include "recipesnapshot.h"
+#include "trigramindex.h"
 using namespace std;
+class QMenu;
+class QAction;
+class QTimer;
+class QThreadPool;
 namespace Ui {
 class MainWindow;
 }
@@ -12,23 +22,119 @@ class MainWindow : public QMainWindow {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // repository, если задан, заменяет PostgreSQL: окно работает с ним без
+    // подключения и без снимка каталога (например, MemoryRecipeRepository)
+    explicit MainWindow(shared_ptr<RecipeRepository> repository = nullptr, QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
     void onAddRecipeClicked();
     void onEditRecipeClicked();
     void onDeleteRecipeClicked();
-    void onRecipeSelected(QListWidgetItem* item);
+    void onRecipeSelected(const QModelIndex& index);
     void onSearchTextChanged(const QString& text);
-    void onTagFilterChanged(int index);
+    void onTagFilterChanged();
+    void onCookableClicked();
+    void onDatabaseReady(bool ok, const QString& error);
+    void onChangeNotified(const ChangeNotification& notification);
 
 private:
-    void loadRecipes();
+    // Хранилище для записи в фоне: свободное соединение пула
+    // или хранилище, переданное окну. Пустой — нет связи с сервером
+    class RepositoryHandle {
+    public:
+        RepositoryHandle(CookBookDatabasePool::Handle lease)
+            : lease_(move(lease)), repository_(lease_ ? &*lease_ : nullptr) {}
+        explicit RepositoryHandle(RecipeRepository* repository) : repository_(repository) {}
+        
+        explicit operator bool() const { return repository_ != nullptr; }
+        RecipeRepository* operator->() const { return repository_; }
+        RecipeRepository& operator*() const { return *repository_; }
+    
+    private:
+        CookBookDatabasePool::Handle lease_;
+        RecipeRepository* repository_;
+    };
+    
+    RepositoryHandle acquireRepository();
+    // write выполняется в фоновом потоке со своим соединением пула,
+    // done — в потоке окна; окно не ждет ни соединения, ни сервера
+    void runWrite(function<bool(RecipeRepository&, RecipeChange&)> write,
+                  function<void(bool, const RecipeChange&)> done);
+    void editRecipe(const Recipe& recipe);
+    void loadRecipes(bool selectFirst = false, bool createDemoIfEmpty = false);
+    void showSearchResults(bool selectFirst);
+    void showFuzzyResults(bool selectFirst);
+    void showCookable(const vector<string>& available);
+    void loadCatalogIndexes(function<void()> ready);
+    void indexRecipe(const Recipe& recipe);
+    void selectFirstVisible();
+    void applyTagFilter();
+    void showListStatus();
+    TagIndex::Mode tagMode() const;
+    void showRecipe(const Recipe& recipe);
     void loadTags();
+    void setTagMenu(const vector<string>& tags);
+    void showSnapshot(bool selectFirst);
+    void applyRecipeChange(const RecipeChange& change);
+    QAction* createTagAction(const string& tag, bool checked = false);
+    void insertTagAction(const string& tag);
+    void applyRemoteChanges();
+    void resyncAfterReconnect();
+    void forgetRecipe(int recipeId);
+    void clearRecipeDetails();
     void applyFilters();
     void createDefaultRecipes();
-
+    void setDatabaseControlsEnabled(bool enabled);
+    void startConnect();
+    
     Ui::MainWindow *ui;
-    unique_ptr<CookBookDatabase> database;
+    shared_ptr<RecipeCache> recipeCache;
+    shared_ptr<RecipeRepository> repository;
+    unique_ptr<CookBookDatabasePool> databasePool;
+    // Первое подключение пула с проверкой схемы, чтобы окно не ждало сервер
+    thread connectThread;
+    bool databaseReady;
+    int connectRetryDelay;
+    
+    // Каталог с прошлого запуска показывается до подключения и без сервера;
+    // после подключения снимок в фоне сверяется с базой и переписывается
+    RecipeSnapshot snapshot;
+    string snapshotPath;
+    thread syncThread;
+    AsyncRecipeRepository* asyncDatabase;
+    QThreadPool* writePool;
+    int selectedRecipeId;
+    int recipesLoadId;
+    string recipeSearch;
+    QTimer* searchTimer;
+    RecipeListModel* recipeModel;
+    
+    // Прошлый поиск, если его выдача полная: следующий запрос, добавляющий
+    // к нему слова, проверяется только на этих рецептах
+    string narrowableSearch;
+    vector<int> narrowableIds;
+    
+    // Теги фильтруются по индексу модели списка
+    vector<string> selectedTags;
+    QMenu* tagMenu;
+    QAction* matchAnyTagAction;
+    
+    // Индексы каталога строятся при первом запросе, которому они нужны,
+    // и дальше обновляются при записи рецептов
+    IngredientIndex ingredientIndex;
+    TrigramIndex trigramIndex;
+    struct IndexedRecipe {
+        string name;
+        vector<string> tags;
+    };
+    unordered_map<int, IndexedRecipe> indexedRecipes;
+    bool catalogIndexReady;
+    QString availableIngredients;
+    
+    // Изменения от других клиентов копятся и применяются пачкой: id → рецепт удален
+    QTimer* remoteChangeTimer;
+    unordered_map<int, bool> remoteChanges;
+    bool remoteTagsChanged;
+    bool changeFeedConnected;
 };
\ No newline at end of file
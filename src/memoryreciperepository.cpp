@@ -0,0 +1,502 @@
+#include "memoryreciperepository.h"
+#include "textfold.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+// Веса полей как у ts_rank по умолчанию: A, B, C, D
+const float SEARCH_WEIGHTS[] = {1.0f, 0.4f, 0.2f, 0.1f};
+// Сколько слов показывать во фрагменте с совпадениями, как MaxWords у ts_headline
+const size_t SNIPPET_WORDS = 15;
+// Сколько рецептов forEachRecipe копирует за одну блокировку
+const size_t FOREACH_CHUNK_SIZE = 256;
+
+bool isWordByte(char c) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    return byte >= 0x80 || isalnum(byte);
+}
+
+// Слова — непрерывные последовательности букв и цифр; байты UTF-8 считаются буквами
+void appendWords(const string& folded, vector<string>& words) {
+    string word;
+    for (char c : folded) {
+        if (isWordByte(c)) {
+            word += c;
+        } else if (!word.empty()) {
+            words.push_back(move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(move(word));
+    }
+}
+
+bool hasPrefixMatch(const vector<string>& words, const string& term) {
+    return any_of(words.begin(), words.end(), [&term](const string& word) {
+        return word.compare(0, term.size(), term) == 0;
+    });
+}
+
+vector<string> sortedTags(vector<string> tags) {
+    sort(tags.begin(), tags.end());
+    tags.erase(unique(tags.begin(), tags.end()), tags.end());
+    return tags;
+}
+
+// Фрагмент описания, ингредиентов и шагов вокруг первого совпадения,
+// найденные слова выделены <b></b> — как ts_headline у сервера
+string buildSnippet(const Recipe& recipe, const vector<string>& terms) {
+    string text = recipe.getDescription();
+    for (const auto& ingredient : recipe.getIngredients()) {
+        text += (text.empty() ? "" : ", ") + ingredient.getName();
+    }
+    for (const auto& step : recipe.getSteps()) {
+        text += (text.empty() ? "" : " ") + step.getDescription();
+    }
+    
+    vector<string> chunks;
+    vector<bool> matched;
+    size_t first = string::npos;
+    
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find_first_of(" \t\n\r", pos);
+        if (end == string::npos) end = text.size();
+        
+        if (end > pos) {
+            vector<string> words;
+            appendWords(foldText(text.substr(pos, end - pos)), words);
+            bool hit = any_of(terms.begin(), terms.end(), [&words](const string& term) {
+                return hasPrefixMatch(words, term);
+            });
+            if (hit && first == string::npos) {
+                first = chunks.size();
+            }
+            chunks.push_back(text.substr(pos, end - pos));
+            matched.push_back(hit);
+        }
+        pos = end + 1;
+    }
+    
+    if (first == string::npos) return string();
+    
+    size_t begin = first > 4 ? first - 4 : 0;
+    size_t end = min(chunks.size(), begin + SNIPPET_WORDS);
+    
+    string snippet;
+    for (size_t i = begin; i < end; ++i) {
+        if (!snippet.empty()) snippet += ' ';
+        snippet += matched[i] ? "<b>" + chunks[i] + "</b>" : chunks[i];
+    }
+    return snippet;
+}
+
+}
+
+MemoryRecipeRepository::MemoryRecipeRepository() : nextId_(1) {
+}
+
+int MemoryRecipeRepository::addRecipe(Recipe& recipe, RecipeChange* change) {
+    auto lock = writeLock();
+    return insertRecipe(recipe, change);
+}
+
+bool MemoryRecipeRepository::addRecipes(vector<Recipe>& recipes) {
+    auto lock = writeLock();
+    
+    recipes_.reserve(recipes_.size() + recipes.size());
+    for (auto& recipe : recipes) {
+        insertRecipe(recipe, nullptr);
+    }
+    return true;
+}
+
+bool MemoryRecipeRepository::updateRecipe(const Recipe& recipe, RecipeChange* change) {
+    auto lock = writeLock();
+    
+    auto it = recipes_.find(recipe.getId());
+    if (it == recipes_.end()) {
+        lastError_ = "Рецепт не найден";
+        return false;
+    }
+    
+    // Ничего не изменилось — версия остается прежней, как у базы
+    StoredRecipe& current = it->second;
+    if (current.recipe.contentHash() == recipe.contentHash()) {
+        fillChange(change, RecipeChange::Updated, current.recipe);
+        return true;
+    }
+    
+    unindexTags(current.recipe.getId(), current.recipe.getTags());
+    nameIndex_.erase({current.recipe.getName(), current.recipe.getId()});
+    
+    current = makeStored(recipe, current.version + 1);
+    nameIndex_.emplace(current.recipe.getName(), current.recipe.getId());
+    
+    fillChange(change, RecipeChange::Updated, current.recipe);
+    indexTags(current.recipe.getId(), current.recipe.getTags(), change ? &change->createdTags : nullptr);
+    return true;
+}
+
+bool MemoryRecipeRepository::deleteRecipe(int recipeId, RecipeChange* change) {
+    if (recipeId <= 0) return false;
+    
+    auto lock = writeLock();
+    
+    // Удаление отсутствующего рецепта, как и в базе, не ошибка
+    auto it = recipes_.find(recipeId);
+    if (it != recipes_.end()) {
+        unindexTags(recipeId, it->second.recipe.getTags());
+        nameIndex_.erase({it->second.recipe.getName(), recipeId});
+        recipes_.erase(it);
+    }
+    
+    if (change) {
+        *change = RecipeChange();
+        change->kind = RecipeChange::Removed;
+        change->id = recipeId;
+    }
+    return true;
+}
+
+shared_ptr<Recipe> MemoryRecipeRepository::getRecipeById(int id) {
+    auto lock = readLock();
+    
+    auto it = recipes_.find(id);
+    if (it == recipes_.end()) return nullptr;
+    return make_shared<Recipe>(it->second.recipe);
+}
+
+vector<shared_ptr<Recipe>> MemoryRecipeRepository::getAllRecipes(int parts) {
+    auto lock = readLock();
+    
+    vector<shared_ptr<Recipe>> recipes;
+    recipes.reserve(recipes_.size());
+    for (const auto& key : nameIndex_) {
+        recipes.push_back(copyParts(recipes_.at(key.second).recipe, parts));
+    }
+    return recipes;
+}
+
+vector<shared_ptr<Recipe>> MemoryRecipeRepository::queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey,
+                                                                int limit) {
+    size_t pageSize = static_cast<size_t>(max(limit, 1));
+    string foldedName = foldText(filter.nameContains);
+    NameKey after(afterKey.name, afterKey.id);
+    
+    auto lock = readLock();
+    vector<shared_ptr<Recipe>> page;
+    
+    if (filter.tags.empty()) {
+        // Обход индекса имен с ключа — цена страницы не зависит от ее номера
+        auto it = afterKey.id > 0 ? nameIndex_.upper_bound(after) : nameIndex_.begin();
+        for (; it != nameIndex_.end() && page.size() < pageSize; ++it) {
+            const StoredRecipe& stored = recipes_.at(it->second);
+            if (matchesFilter(stored, filter, foldedName)) {
+                page.push_back(copyParts(stored.recipe, RecipeTags));
+            }
+        }
+        return page;
+    }
+    
+    // С тегами кандидатов дает пересечение списков тегов, порядок имен — частичная сортировка
+    vector<NameKey> keys;
+    for (int id : recipesWithTags(filter.tags)) {
+        const StoredRecipe& stored = recipes_.at(id);
+        NameKey key(stored.recipe.getName(), id);
+        if (afterKey.id > 0 && !(after < key)) continue;
+        if (matchesFilter(stored, filter, foldedName)) {
+            keys.push_back(move(key));
+        }
+    }
+    
+    size_t count = min(pageSize, keys.size());
+    partial_sort(keys.begin(), keys.begin() + count, keys.end());
+    
+    page.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        page.push_back(copyParts(recipes_.at(keys[i].second).recipe, RecipeTags));
+    }
+    return page;
+}
+
+vector<RecipeSearchResult> MemoryRecipeRepository::searchRecipes(const string& text, const vector<string>& tags,
+                                                                 int limit, const vector<int>& within) {
+    vector<string> terms;
+    appendWords(foldText(text), terms);
+    if (terms.empty()) return {};
+    
+    auto lock = readLock();
+    
+    // Кандидаты: прошлая выдача, иначе рецепты со всеми тегами, иначе весь каталог
+    vector<int> candidates;
+    if (!within.empty()) {
+        candidates = within;
+    } else if (!tags.empty()) {
+        candidates = recipesWithTags(tags);
+    } else {
+        candidates.reserve(recipes_.size());
+        for (const auto& entry : recipes_) {
+            candidates.push_back(entry.first);
+        }
+    }
+    
+    vector<pair<float, int>> ranked;
+    for (int id : candidates) {
+        auto it = recipes_.find(id);
+        if (it == recipes_.end()) continue;
+        const StoredRecipe& stored = it->second;
+        
+        if (!within.empty() && !tags.empty()) {
+            const vector<string>& recipeTags = stored.recipe.getTags();
+            bool hasAll = all_of(tags.begin(), tags.end(), [&recipeTags](const string& tag) {
+                return binary_search(recipeTags.begin(), recipeTags.end(), tag);
+            });
+            if (!hasAll) continue;
+        }
+        
+        // Каждое слово запроса должно найтись; засчитывается самое весомое поле
+        float rank = 0;
+        bool all = true;
+        for (const auto& term : terms) {
+            int field = 0;
+            while (field < SEARCH_FIELDS && !hasPrefixMatch(stored.words[field], term)) {
+                ++field;
+            }
+            if (field == SEARCH_FIELDS) {
+                all = false;
+                break;
+            }
+            rank += SEARCH_WEIGHTS[field];
+        }
+        
+        if (all) {
+            ranked.emplace_back(rank / terms.size(), id);
+        }
+    }
+    
+    size_t count = min(static_cast<size_t>(max(limit, 1)), ranked.size());
+    partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    
+    vector<RecipeSearchResult> found;
+    found.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Recipe& recipe = recipes_.at(ranked[i].second).recipe;
+        
+        RecipeSearchResult result;
+        result.id = recipe.getId();
+        result.name = recipe.getName();
+        result.rank = ranked[i].first;
+        result.snippet = buildSnippet(recipe, terms);
+        result.tags = recipe.getTags();
+        found.push_back(move(result));
+    }
+    return found;
+}
+
+bool MemoryRecipeRepository::forEachRecipe(const function<bool(Recipe&&)>& consumer) {
+    NameKey after;
+    bool started = false;
+    
+    while (true) {
+        vector<Recipe> chunk;
+        {
+            auto lock = readLock();
+            auto it = started ? nameIndex_.upper_bound(after) : nameIndex_.begin();
+            for (; it != nameIndex_.end() && chunk.size() < FOREACH_CHUNK_SIZE; ++it) {
+                chunk.push_back(*copyParts(recipes_.at(it->second).recipe, RecipeTags));
+            }
+        }
+        
+        if (chunk.empty()) return true;
+        
+        // Следующая порция продолжается с ключа, поэтому запись между порциями не сбивает обход
+        after = {chunk.back().getName(), chunk.back().getId()};
+        started = true;
+        
+        for (auto& recipe : chunk) {
+            if (!consumer(move(recipe))) return true;
+        }
+    }
+}
+
+vector<string> MemoryRecipeRepository::getAllTags() {
+    auto lock = readLock();
+    
+    vector<string> tags;
+    tags.reserve(tagIndex_.size());
+    for (const auto& entry : tagIndex_) {
+        tags.push_back(entry.first);
+    }
+    return tags;
+}
+
+bool MemoryRecipeRepository::getRecipeVersions(unordered_map<int, int>& versions) {
+    auto lock = readLock();
+    
+    versions.clear();
+    versions.reserve(recipes_.size());
+    for (const auto& entry : recipes_) {
+        versions[entry.first] = entry.second.version;
+    }
+    return true;
+}
+
+string MemoryRecipeRepository::getLastError() const {
+    auto lock = readLock();
+    return lastError_;
+}
+
+size_t MemoryRecipeRepository::size() const {
+    auto lock = readLock();
+    return recipes_.size();
+}
+
+shared_lock<shared_mutex> MemoryRecipeRepository::readLock() const {
+    lock_guard<mutex> gate(writerGate_);
+    return shared_lock<shared_mutex>(mutex_);
+}
+
+unique_lock<shared_mutex> MemoryRecipeRepository::writeLock() {
+    lock_guard<mutex> gate(writerGate_);
+    return unique_lock<shared_mutex>(mutex_);
+}
+
+int MemoryRecipeRepository::insertRecipe(Recipe& recipe, RecipeChange* change) {
+    int recipeId = nextId_++;
+    recipe.setId(recipeId);
+    
+    StoredRecipe stored = makeStored(recipe, 1);
+    nameIndex_.emplace(stored.recipe.getName(), recipeId);
+    
+    fillChange(change, RecipeChange::Inserted, stored.recipe);
+    indexTags(recipeId, stored.recipe.getTags(), change ? &change->createdTags : nullptr);
+    
+    recipes_.emplace(recipeId, move(stored));
+    return recipeId;
+}
+
+void MemoryRecipeRepository::indexTags(int recipeId, const vector<string>& tags, vector<string>* createdTags) {
+    for (const auto& tag : tags) {
+        auto [it, created] = tagIndex_.try_emplace(tag);
+        if (created && createdTags) {
+            createdTags->push_back(tag);
+        }
+        
+        vector<int>& ids = it->second;
+        ids.insert(lower_bound(ids.begin(), ids.end(), recipeId), recipeId);
+    }
+}
+
+void MemoryRecipeRepository::unindexTags(int recipeId, const vector<string>& tags) {
+    for (const auto& tag : tags) {
+        auto it = tagIndex_.find(tag);
+        if (it == tagIndex_.end()) continue;
+        
+        vector<int>& ids = it->second;
+        auto pos = lower_bound(ids.begin(), ids.end(), recipeId);
+        if (pos != ids.end() && *pos == recipeId) {
+            ids.erase(pos);
+        }
+    }
+}
+
+MemoryRecipeRepository::StoredRecipe MemoryRecipeRepository::makeStored(const Recipe& recipe, int version) {
+    StoredRecipe stored{recipe, version, foldText(recipe.getName()), {}};
+    
+    stored.recipe.clearTags();
+    for (auto& tag : sortedTags(recipe.getTags())) {
+        stored.recipe.addTag(move(tag));
+    }
+    
+    appendWords(stored.foldedName, stored.words[0]);
+    appendWords(foldText(recipe.getDescription()), stored.words[1]);
+    for (const auto& ingredient : recipe.getIngredients()) {
+        appendWords(foldText(ingredient.getName()), stored.words[2]);
+    }
+    for (const auto& step : recipe.getSteps()) {
+        appendWords(foldText(step.getDescription()), stored.words[3]);
+    }
+    return stored;
+}
+
+void MemoryRecipeRepository::fillChange(RecipeChange* change, RecipeChange::Kind kind, const Recipe& stored) {
+    if (!change) return;
+    
+    *change = RecipeChange();
+    change->kind = kind;
+    change->id = stored.getId();
+    change->name = stored.getName();
+    change->tags = stored.getTags();
+}
+
+bool MemoryRecipeRepository::matchesFilter(const StoredRecipe& stored, const RecipeFilter& filter,
+                                           const string& foldedName) const {
+    const Recipe& recipe = stored.recipe;
+    
+    if (!foldedName.empty() && stored.foldedName.find(foldedName) == string::npos) return false;
+    if (!filter.anyTags.empty()) {
+        const vector<string>& tags = recipe.getTags();
+        bool hasAny = any_of(filter.anyTags.begin(), filter.anyTags.end(), [&tags](const string& tag) {
+            return binary_search(tags.begin(), tags.end(), tag);
+        });
+        if (!hasAny) return false;
+    }
+    if (!filter.category.empty() && recipe.getCategory() != filter.category) return false;
+    if (!filter.difficulty.empty() && recipe.getDifficulty() != filter.difficulty) return false;
+    if (filter.minCookingTime > 0 && recipe.getCookingTime() < filter.minCookingTime) return false;
+    if (filter.maxCookingTime > 0 && recipe.getCookingTime() > filter.maxCookingTime) return false;
+    return true;
+}
+
+vector<int> MemoryRecipeRepository::recipesWithTags(const vector<string>& tags) const {
+    // Пересечение начинается с самого короткого списка
+    vector<const vector<int>*> lists;
+    for (const auto& tag : tags) {
+        auto it = tagIndex_.find(tag);
+        if (it == tagIndex_.end()) return {};
+        lists.push_back(&it->second);
+    }
+    sort(lists.begin(), lists.end(), [](const vector<int>* a, const vector<int>* b) { return a->size() < b->size(); });
+    
+    vector<int> ids = *lists.front();
+    for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+        vector<int> common;
+        set_intersection(ids.begin(), ids.end(), lists[i]->begin(), lists[i]->end(), back_inserter(common));
+        ids.swap(common);
+    }
+    return ids;
+}
+
+shared_ptr<Recipe> MemoryRecipeRepository::copyParts(const Recipe& recipe, int parts) {
+    auto copy = make_shared<Recipe>(recipe.getName(), recipe.getDescription());
+    copy->setId(recipe.getId());
+    copy->setCookingTime(recipe.getCookingTime());
+    copy->setDifficulty(recipe.getDifficulty());
+    copy->setCategory(recipe.getCategory());
+    
+    if (parts & RecipeIngredients) {
+        for (const auto& ingredient : recipe.getIngredients()) {
+            copy->addIngredient(ingredient);
+        }
+    }
+    if (parts & RecipeSteps) {
+        for (const auto& step : recipe.getSteps()) {
+            copy->addStep(step);
+        }
+    }
+    if (parts & RecipeTags) {
+        for (const auto& tag : recipe.getTags()) {
+            copy->addTag(tag);
+        }
+    }
+    return copy;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "recipe.h"
+#include "reciperepository.h"
+using namespace std;
+
+// Хранилище рецептов в памяти процесса — для замеров и нагрузочных прогонов
+// без PostgreSQL. Рецепты лежат в хэш-таблице по id; порядок (name, id) держит
+// упорядоченный индекс имен, теги — индекс тег -> отсортированные id.
+// Чтения идут параллельно под разделяемой блокировкой, запись — под исключительной
+// и без очереди за новыми читателями.
+// Поиск повторяет смысл серверного: все слова запроса как префиксы слов рецепта,
+// веса полей как у ts_rank (название, описание, ингредиенты, шаги)
+class MemoryRecipeRepository : public RecipeRepository {
+public:
+    MemoryRecipeRepository();
+    
+    int addRecipe(Recipe& recipe, RecipeChange* change = nullptr) override;
+    bool addRecipes(vector<Recipe>& recipes) override;
+    bool updateRecipe(const Recipe& recipe, RecipeChange* change = nullptr) override;
+    bool deleteRecipe(int recipeId, RecipeChange* change = nullptr) override;
+    shared_ptr<Recipe> getRecipeById(int id) override;
+    vector<shared_ptr<Recipe>> getAllRecipes(int parts = RecipeSummary) override;
+    
+    vector<shared_ptr<Recipe>> queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) override;
+    vector<RecipeSearchResult> searchRecipes(const string& text, const vector<string>& tags = {}, int limit = 50,
+                                             const vector<int>& within = {}) override;
+    
+    // Рецепты копируются порциями под блокировкой, consumer вызывается без нее
+    // и может сам писать в хранилище
+    bool forEachRecipe(const function<bool(Recipe&&)>& consumer) override;
+    
+    vector<string> getAllTags() override;
+    bool getRecipeVersions(unordered_map<int, int>& versions) override;
+    
+    string getLastError() const override;
+    
+    size_t size() const;
+
+private:
+    // Поля поиска по убыванию веса: название, описание, ингредиенты, шаги
+    static const int SEARCH_FIELDS = 4;
+    
+    struct StoredRecipe {
+        Recipe recipe;                          // теги отсортированы и без повторов
+        int version;
+        string foldedName;
+        vector<string> words[SEARCH_FIELDS];    // слова полей после foldText
+    };
+    
+    using NameKey = pair<string, int>;
+    
+    // shared_mutex пропускает новых читателей вперед ждущего писателя, и под
+    // непрерывным чтением запись не проходит. Писатель ждет, заняв writerGate_,
+    // а читатель входит через него — новые чтения встают за записью
+    shared_lock<shared_mutex> readLock() const;
+    unique_lock<shared_mutex> writeLock();
+    
+    // Вызываются под исключительной блокировкой
+    int insertRecipe(Recipe& recipe, RecipeChange* change);
+    void indexTags(int recipeId, const vector<string>& tags, vector<string>* createdTags);
+    void unindexTags(int recipeId, const vector<string>& tags);
+    static StoredRecipe makeStored(const Recipe& recipe, int version);
+    static void fillChange(RecipeChange* change, RecipeChange::Kind kind, const Recipe& stored);
+    
+    // Вызываются под любой блокировкой; filter.tags проверяет recipesWithTags
+    bool matchesFilter(const StoredRecipe& stored, const RecipeFilter& filter, const string& foldedName) const;
+    vector<int> recipesWithTags(const vector<string>& tags) const;
+    static shared_ptr<Recipe> copyParts(const Recipe& recipe, int parts);
+    
+    unordered_map<int, StoredRecipe> recipes_;
+    set<NameKey> nameIndex_;
+    map<string, vector<int>> tagIndex_;         // тег остается и без рецептов, как в базе
+    int nextId_;
+    string lastError_;
+    mutable shared_mutex mutex_;
+    mutable mutex writerGate_;
+};
\ No newline at end of file
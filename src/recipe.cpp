@@ -2,18 +2,18 @@
 #include <algorithm>
 using namespace std;
 
-Ingredient::Ingredient(const string& name, const string& quantity, const string& unit) 
-    : name_(name), quantity_(quantity), unit_(unit) {}
+Ingredient::Ingredient(string name, string quantity, string unit) 
+    : name_(move(name)), quantity_(move(quantity)), unit_(move(unit)) {}
 
-CookingStep::CookingStep(int number, const string& description) 
-    : stepNumber_(number), description_(description) {}
+CookingStep::CookingStep(int number, string description) 
+    : stepNumber_(number), description_(move(description)) {}
 
-Recipe::Recipe(const string& name, const string& description) 
-    : id_(-1), name_(name), description_(description), cookingTime_(0), 
+Recipe::Recipe(string name, string description) 
+    : id_(-1), name_(move(name)), description_(move(description)), cookingTime_(0), 
       difficulty_("Средний"), category_("Основное") {}
 
-void Recipe::addIngredient(const Ingredient& ingredient) {
-    ingredients_.push_back(ingredient);
+void Recipe::addIngredient(Ingredient ingredient) {
+    ingredients_.push_back(move(ingredient));
 }
 
 void Recipe::removeIngredient(int index) {
@@ -26,11 +26,12 @@ void Recipe::clearIngredients() {
     ingredients_.clear();
 }
 
-void Recipe::addStep(const CookingStep& step) {
-    steps_.push_back(step);
-    sort(steps_.begin(), steps_.end(), [](const CookingStep& a, const CookingStep& b) {
+void Recipe::addStep(CookingStep step) {
+    // Шаги обычно приходят по порядку — тогда просто добавляем в конец
+    auto position = upper_bound(steps_.begin(), steps_.end(), step, [](const CookingStep& a, const CookingStep& b) {
         return a.getStepNumber() < b.getStepNumber();
     });
+    steps_.insert(position, move(step));
 }
 
 void Recipe::removeStep(int index) {
@@ -46,9 +47,9 @@ void Recipe::clearSteps() {
     steps_.clear();
 }
 
-void Recipe::addTag(const string& tag) {
+void Recipe::addTag(string tag) {
     if (!hasTag(tag)) {
-        tags_.push_back(tag);
+        tags_.push_back(move(tag));
     }
 }
 
@@ -62,4 +63,61 @@ bool Recipe::hasTag(const string& tag) const {
 
 void Recipe::clearTags() {
     tags_.clear();
+}
+
+namespace {
+
+// FNV-1a; длина перед каждым полем, чтобы "ab"+"c" и "a"+"bc" давали разный хэш
+struct ContentHasher {
+    uint64_t value = 14695981039346656037ull;
+    
+    void addBytes(const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            value = (value ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    
+    void add(int64_t number) {
+        addBytes(&number, sizeof(number));
+    }
+    
+    void add(const string& text) {
+        add(static_cast<int64_t>(text.size()));
+        addBytes(text.data(), text.size());
+    }
+};
+
+}
+
+uint64_t Recipe::contentHash() const {
+    ContentHasher hasher;
+    hasher.add(name_);
+    hasher.add(description_);
+    hasher.add(cookingTime_);
+    hasher.add(difficulty_);
+    hasher.add(category_);
+    
+    hasher.add(static_cast<int64_t>(ingredients_.size()));
+    for (const auto& ingredient : ingredients_) {
+        hasher.add(ingredient.getName());
+        hasher.add(ingredient.getQuantity());
+        hasher.add(ingredient.getUnit());
+    }
+    
+    hasher.add(static_cast<int64_t>(steps_.size()));
+    for (const auto& step : steps_) {
+        hasher.add(step.getStepNumber());
+        hasher.add(step.getDescription());
+    }
+    
+    // В базе теги хранятся множеством
+    vector<string> tags = tags_;
+    sort(tags.begin(), tags.end());
+    hasher.add(static_cast<int64_t>(tags.size()));
+    for (const auto& tag : tags) {
+        hasher.add(tag);
+    }
+    
+    return hasher.value;
 }
\ No newline at end of file
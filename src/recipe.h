@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
@@ -6,15 +7,15 @@ using namespace std;
 
 class Ingredient {
 public:
-    Ingredient(const string& name, const string& quantity, const string& unit = "");
+    Ingredient(string name, string quantity, string unit = "");
     
-    string getName() const { return name_; }
-    string getQuantity() const { return quantity_; }
-    string getUnit() const { return unit_; }
+    const string& getName() const { return name_; }
+    const string& getQuantity() const { return quantity_; }
+    const string& getUnit() const { return unit_; }
     
-    void setName(const string& name) { name_ = name; }
-    void setQuantity(const string& quantity) { quantity_ = quantity; }
-    void setUnit(const string& unit) { unit_ = unit; }
+    void setName(string name) { name_ = move(name); }
+    void setQuantity(string quantity) { quantity_ = move(quantity); }
+    void setUnit(string unit) { unit_ = move(unit); }
     
 private:
     string name_;
@@ -24,13 +25,13 @@ private:
 
 class CookingStep {
 public:
-    CookingStep(int number, const string& description);
+    CookingStep(int number, string description);
     
     int getStepNumber() const { return stepNumber_; }
-    string getDescription() const { return description_; }
+    const string& getDescription() const { return description_; }
     
     void setStepNumber(int number) { stepNumber_ = number; }
-    void setDescription(const string& description) { description_ = description; }
+    void setDescription(string description) { description_ = move(description); }
     
 private:
     int stepNumber_;
@@ -39,38 +40,43 @@ private:
 
 class Recipe {
 public:
-    Recipe(const string& name, const string& description = "");
+    Recipe(string name, string description = "");
     
     int getId() const { return id_; }
-    string getName() const { return name_; }
-    string getDescription() const { return description_; }
+    const string& getName() const { return name_; }
+    const string& getDescription() const { return description_; }
     int getCookingTime() const { return cookingTime_; }
-    string getDifficulty() const { return difficulty_; }
-    string getCategory() const { return category_; }
-    vector<Ingredient> getIngredients() const { return ingredients_; }
-    vector<CookingStep> getSteps() const { return steps_; }
-    vector<string> getTags() const { return tags_; }
+    const string& getDifficulty() const { return difficulty_; }
+    const string& getCategory() const { return category_; }
+    const vector<Ingredient>& getIngredients() const { return ingredients_; }
+    const vector<CookingStep>& getSteps() const { return steps_; }
+    const vector<string>& getTags() const { return tags_; }
     
+    // Строковые параметры принимаются по значению и перемещаются внутрь
     void setId(int id) { id_ = id; }
-    void setName(const string& name) { name_ = name; }
-    void setDescription(const string& description) { description_ = description; }
+    void setName(string name) { name_ = move(name); }
+    void setDescription(string description) { description_ = move(description); }
     void setCookingTime(int time) { cookingTime_ = time; }
-    void setDifficulty(const string& difficulty) { difficulty_ = difficulty; }
-    void setCategory(const string& category) { category_ = category; }
+    void setDifficulty(string difficulty) { difficulty_ = move(difficulty); }
+    void setCategory(string category) { category_ = move(category); }
     
-    void addIngredient(const Ingredient& ingredient);
+    void addIngredient(Ingredient ingredient);
     void removeIngredient(int index);
     void clearIngredients();
     
-    void addStep(const CookingStep& step);
+    void addStep(CookingStep step);
     void removeStep(int index);
     void clearSteps();
     
-    void addTag(const string& tag);
+    void addTag(string tag);
     void removeTag(const string& tag);
     bool hasTag(const string& tag) const;
     void clearTags();
     
+    // Хэш всего содержимого без id; порядок тегов не важен. Совпадение хэшей
+    // отредактированного и сохраненного рецепта значит, что записывать нечего
+    uint64_t contentHash() const;
+    
 private:
     int id_;
     string name_;
@@ -0,0 +1,182 @@
+#include "memoryreciperepository.h"
+#include "recipe.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Нагрузочный прогон MemoryRecipeRepository без PostgreSQL и без окна:
+// заполнение каталога, листание страницами, фильтр по тегам, поиск и
+// параллельное чтение под записью. Порядок страниц и их полнота проверяются,
+// поэтому прогон годится и как быстрая проверка хранилища.
+// Запуск: CookBookBench [рецептов] [потоков чтения]
+
+static const int DEFAULT_RECIPES = 100000;
+static const int DEFAULT_READERS = 4;
+static const int PAGE_SIZE = 100;
+static const int SEARCH_LIMIT = 50;
+static const int TAG_COUNT = 40;
+static const int CONCURRENT_MS = 2000;
+
+static const char* const DISHES[] = {"Суп", "Салат", "Пирог", "Рагу", "Каша", "Омлет", "Паста", "Плов", "Запеканка", "Блины"};
+static const char* const MAIN_INGREDIENTS[] = {"курица", "говядина", "грибы", "тыква", "рис", "сыр", "шпинат", "лосось", "фасоль", "яблоки"};
+static const char* const STYLES[] = {"по-домашнему", "острый", "быстрый", "праздничный", "постный", "летний", "зимний", "деревенский"};
+
+template <typename T, size_t N>
+static const T& pick(const T (&items)[N], size_t i) {
+    return items[i % N];
+}
+
+static Recipe makeRecipe(int i) {
+    string name = string(pick(DISHES, i)) + " " + pick(MAIN_INGREDIENTS, i / 10) + " " + pick(STYLES, i / 100) +
+                  " №" + to_string(i);
+    Recipe recipe(name, string("Рецепт ") + pick(STYLES, i) + ", основа — " + pick(MAIN_INGREDIENTS, i * 7));
+    recipe.setCookingTime(10 + i % 120);
+    recipe.setDifficulty(i % 3 == 0 ? "Легкий" : i % 3 == 1 ? "Средний" : "Сложный");
+    recipe.setCategory(pick(DISHES, i / 3));
+    
+    for (int j = 0; j < 5 + i % 6; ++j) {
+        recipe.addIngredient(Ingredient(pick(MAIN_INGREDIENTS, i + j * 3), to_string(1 + j), "шт"));
+    }
+    for (int j = 1; j <= 4; ++j) {
+        recipe.addStep(CookingStep(j, string("Шаг ") + to_string(j) + ": " + pick(STYLES, i + j) + " способ"));
+    }
+    for (int j = 0; j < 1 + i % 4; ++j) {
+        recipe.addTag("тег" + to_string((i * 13 + j * 7) % TAG_COUNT));
+    }
+    return recipe;
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Листает выборку до конца; false — страницы не в порядке (name, id) или с повторами
+static bool pageAll(MemoryRecipeRepository& repository, const RecipeFilter& filter, size_t& total) {
+    RecipeKey key;
+    total = 0;
+    while (true) {
+        vector<shared_ptr<Recipe>> page = repository.queryRecipes(filter, key, PAGE_SIZE);
+        for (const auto& recipe : page) {
+            int order = recipe->getName().compare(key.name);
+            if (key.id > 0 && (order < 0 || (order == 0 && recipe->getId() <= key.id))) return false;
+            key.name = recipe->getName();
+            key.id = recipe->getId();
+        }
+        total += page.size();
+        if (static_cast<int>(page.size()) < PAGE_SIZE) return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int recipeCount = argc > 1 ? atoi(argv[1]) : DEFAULT_RECIPES;
+    int readerCount = argc > 2 ? atoi(argv[2]) : DEFAULT_READERS;
+    if (recipeCount <= 0 || readerCount <= 0) {
+        cerr << "Использование: " << argv[0] << " [рецептов] [потоков чтения]" << endl;
+        return 2;
+    }
+    
+    MemoryRecipeRepository repository;
+    
+    // Заполнение одним пакетом, как импорт
+    vector<Recipe> recipes;
+    recipes.reserve(recipeCount);
+    for (int i = 0; i < recipeCount; ++i) {
+        recipes.push_back(makeRecipe(i));
+    }
+    auto start = chrono::steady_clock::now();
+    if (!repository.addRecipes(recipes)) {
+        cerr << "Не удалось добавить рецепты: " << repository.getLastError() << endl;
+        return 1;
+    }
+    cout << "Добавлено " << repository.size() << " рецептов за " << millisecondsSince(start) << " мс" << endl;
+    
+    // Весь список страницами по ключу (name, id)
+    size_t total = 0;
+    start = chrono::steady_clock::now();
+    if (!pageAll(repository, RecipeFilter(), total) || total != repository.size()) {
+        cerr << "Список без фильтра: нарушен порядок или прочитано " << total << " из " << repository.size() << endl;
+        return 1;
+    }
+    cout << "Список страницами по " << PAGE_SIZE << ": " << millisecondsSince(start) << " мс" << endl;
+    
+    // Фильтры по тегам: "любой" покрывает все рецепты с одним из тегов, "все" — их пересечение
+    RecipeFilter allTags;
+    allTags.tags = {"тег1", "тег8"};
+    RecipeFilter anyTags;
+    anyTags.anyTags = {"тег1", "тег8"};
+    size_t allCount = 0;
+    size_t anyCount = 0;
+    start = chrono::steady_clock::now();
+    if (!pageAll(repository, allTags, allCount) || !pageAll(repository, anyTags, anyCount) || allCount > anyCount) {
+        cerr << "Фильтр по тегам: нарушен порядок или \"все\" (" << allCount << ") больше \"любого\" ("
+             << anyCount << ")" << endl;
+        return 1;
+    }
+    cout << "Теги: все — " << allCount << ", любой — " << anyCount << ", " << millisecondsSince(start) << " мс" << endl;
+    
+    // Поиск по префиксам слов
+    const char* const queries[] = {"суп", "пирог тыква", "лосось празд", "шаг", "нет такого слова"};
+    start = chrono::steady_clock::now();
+    for (const char* query : queries) {
+        vector<RecipeSearchResult> results = repository.searchRecipes(query, {}, SEARCH_LIMIT);
+        for (size_t i = 1; i < results.size(); ++i) {
+            if (results[i].rank > results[i - 1].rank) {
+                cerr << "Поиск \"" << query << "\": выдача не по убыванию rank" << endl;
+                return 1;
+            }
+        }
+        cout << "Поиск \"" << query << "\": " << results.size() << " совпадений" << endl;
+    }
+    cout << "Поиск, " << size(queries) << " запросов: " << millisecondsSince(start) << " мс" << endl;
+    
+    // Чтение из нескольких потоков, пока один поток правит рецепты
+    atomic<bool> stop(false);
+    atomic<long> reads(0);
+    atomic<long> writes(0);
+    atomic<bool> failed(false);
+    vector<thread> threads;
+    for (int t = 0; t < readerCount; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = t; !stop; i += readerCount) {
+                int id = 1 + i % recipeCount;
+                if (!repository.getRecipeById(id)) {
+                    failed = true;
+                }
+                if (i % 64 == 0) {
+                    repository.searchRecipes(pick(MAIN_INGREDIENTS, i), {}, SEARCH_LIMIT);
+                }
+                ++reads;
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        for (int i = 0; !stop; ++i) {
+            Recipe recipe = makeRecipe(i % recipeCount);
+            recipe.setId(1 + i % recipeCount);
+            recipe.setCookingTime(1 + i % 200);
+            if (!repository.updateRecipe(recipe)) {
+                failed = true;
+            }
+            ++writes;
+        }
+    });
+    this_thread::sleep_for(chrono::milliseconds(CONCURRENT_MS));
+    stop = true;
+    for (auto& worker : threads) {
+        worker.join();
+    }
+    if (failed) {
+        cerr << "Параллельный прогон: рецепт не найден или не записан: " << repository.getLastError() << endl;
+        return 1;
+    }
+    cout << "Параллельно за " << CONCURRENT_MS << " мс: чтений " << reads << " (" << readerCount
+         << " потоков), записей " << writes << endl;
+    
+    return 0;
+}
\ No newline at end of file
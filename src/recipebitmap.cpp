@@ -0,0 +1,231 @@
+#include "recipebitmap.h"
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+bool RecipeBitmap::Container::contains(uint16_t low) const {
+    if (isBitmap()) {
+        return (words[low >> 6] >> (low & 63)) & 1;
+    }
+    return binary_search(values.begin(), values.end(), low);
+}
+
+void RecipeBitmap::Container::toBitmap() {
+    words.assign(BITMAP_WORDS, 0);
+    for (uint16_t low : values) {
+        words[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    values.clear();
+    values.shrink_to_fit();
+}
+
+void RecipeBitmap::Container::toArray() {
+    values.clear();
+    values.reserve(count);
+    for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+        uint64_t word = words[i];
+        while (word) {
+            values.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+            word &= word - 1;
+        }
+    }
+    words.clear();
+    words.shrink_to_fit();
+}
+
+RecipeBitmap::Container* RecipeBitmap::find(uint16_t key) {
+    auto it = lower_bound(containers_.begin(), containers_.end(), key,
+                          [](const Container& c, uint16_t k) { return c.key < k; });
+    return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+const RecipeBitmap::Container* RecipeBitmap::find(uint16_t key) const {
+    return const_cast<RecipeBitmap*>(this)->find(key);
+}
+
+void RecipeBitmap::add(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+    
+    auto it = lower_bound(containers_.begin(), containers_.end(), key,
+                          [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container());
+        it->key = key;
+    }
+    
+    Container& container = *it;
+    if (container.isBitmap()) {
+        uint64_t& word = container.words[low >> 6];
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(word & mask)) {
+            word |= mask;
+            ++container.count;
+        }
+        return;
+    }
+    
+    auto position = lower_bound(container.values.begin(), container.values.end(), low);
+    if (position != container.values.end() && *position == low) return;
+    
+    container.values.insert(position, low);
+    if (++container.count > ARRAY_LIMIT) {
+        container.toBitmap();
+    }
+}
+
+void RecipeBitmap::remove(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+    
+    Container* container = find(key);
+    if (!container || !container->contains(low)) return;
+    
+    if (container->isBitmap()) {
+        container->words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        if (--container->count <= ARRAY_LIMIT) {
+            container->toArray();
+        }
+    } else {
+        container->values.erase(lower_bound(container->values.begin(), container->values.end(), low));
+        --container->count;
+    }
+    
+    if (container->count == 0) {
+        containers_.erase(containers_.begin() + (container - containers_.data()));
+    }
+}
+
+bool RecipeBitmap::contains(uint32_t value) const {
+    const Container* container = find(static_cast<uint16_t>(value >> 16));
+    return container && container->contains(static_cast<uint16_t>(value & 0xFFFF));
+}
+
+size_t RecipeBitmap::cardinality() const {
+    size_t total = 0;
+    for (const auto& container : containers_) {
+        total += container.count;
+    }
+    return total;
+}
+
+vector<uint32_t> RecipeBitmap::toVector() const {
+    vector<uint32_t> result;
+    result.reserve(cardinality());
+    forEach([&](uint32_t value) { result.push_back(value); });
+    return result;
+}
+
+RecipeBitmap::Container RecipeBitmap::intersect(const Container& a, const Container& b) {
+    Container result;
+    result.key = a.key;
+    
+    if (a.isBitmap() && b.isBitmap()) {
+        result.words.resize(BITMAP_WORDS);
+        for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+            result.words[i] = a.words[i] & b.words[i];
+            result.count += static_cast<uint32_t>(__builtin_popcountll(result.words[i]));
+        }
+        if (result.count <= ARRAY_LIMIT) {
+            result.toArray();
+        }
+        return result;
+    }
+    
+    // Хотя бы один блок разреженный — результат не больше него
+    if (a.isBitmap() || b.isBitmap()) {
+        const Container& sparse = a.isBitmap() ? b : a;
+        const Container& dense = a.isBitmap() ? a : b;
+        for (uint16_t low : sparse.values) {
+            if (dense.contains(low)) {
+                result.values.push_back(low);
+            }
+        }
+    } else {
+        set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                         back_inserter(result.values));
+    }
+    
+    result.count = static_cast<uint32_t>(result.values.size());
+    return result;
+}
+
+RecipeBitmap::Container RecipeBitmap::unite(const Container& a, const Container& b) {
+    Container result;
+    result.key = a.key;
+    
+    if (!a.isBitmap() && !b.isBitmap() && a.count + b.count <= ARRAY_LIMIT) {
+        result.values.reserve(a.count + b.count);
+        set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(),
+                  back_inserter(result.values));
+        result.count = static_cast<uint32_t>(result.values.size());
+        return result;
+    }
+    
+    result.words.assign(BITMAP_WORDS, 0);
+    for (const Container* source : {&a, &b}) {
+        if (source->isBitmap()) {
+            for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+                result.words[i] |= source->words[i];
+            }
+        } else {
+            for (uint16_t low : source->values) {
+                result.words[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+    }
+    
+    for (uint64_t word : result.words) {
+        result.count += static_cast<uint32_t>(__builtin_popcountll(word));
+    }
+    if (result.count <= ARRAY_LIMIT) {
+        result.toArray();
+    }
+    return result;
+}
+
+RecipeBitmap RecipeBitmap::intersect(const RecipeBitmap& a, const RecipeBitmap& b) {
+    RecipeBitmap result;
+    
+    // Блоки, которых нет в одном из множеств, пропускаются целиком
+    auto first = a.containers_.begin();
+    auto second = b.containers_.begin();
+    while (first != a.containers_.end() && second != b.containers_.end()) {
+        if (first->key < second->key) {
+            ++first;
+        } else if (second->key < first->key) {
+            ++second;
+        } else {
+            Container container = intersect(*first, *second);
+            if (container.count > 0) {
+                result.containers_.push_back(move(container));
+            }
+            ++first;
+            ++second;
+        }
+    }
+    
+    return result;
+}
+
+RecipeBitmap RecipeBitmap::unite(const RecipeBitmap& a, const RecipeBitmap& b) {
+    RecipeBitmap result;
+    result.containers_.reserve(a.containers_.size() + b.containers_.size());
+    
+    auto first = a.containers_.begin();
+    auto second = b.containers_.begin();
+    while (first != a.containers_.end() || second != b.containers_.end()) {
+        if (second == b.containers_.end() || (first != a.containers_.end() && first->key < second->key)) {
+            result.containers_.push_back(*first++);
+        } else if (first == a.containers_.end() || second->key < first->key) {
+            result.containers_.push_back(*second++);
+        } else {
+            result.containers_.push_back(unite(*first, *second));
+            ++first;
+            ++second;
+        }
+    }
+    
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+// Сжатое множество идентификаторов рецептов в духе Roaring: значения делятся
+// на блоки по старшим 16 битам, блок хранит младшие биты либо отсортированным
+// массивом (разреженный), либо битовой картой на 65536 бит (плотный).
+// Пересечение и объединение идут поблочно, не разворачивая множество целиком
+class RecipeBitmap {
+public:
+    void add(uint32_t value);
+    void remove(uint32_t value);
+    bool contains(uint32_t value) const;
+    
+    size_t cardinality() const;
+    bool isEmpty() const { return containers_.empty(); }
+    void clear() { containers_.clear(); }
+    
+    static RecipeBitmap intersect(const RecipeBitmap& a, const RecipeBitmap& b);
+    static RecipeBitmap unite(const RecipeBitmap& a, const RecipeBitmap& b);
+    
+    // Обход значений по возрастанию
+    template <typename Visit>
+    void forEach(Visit visit) const;
+    
+    vector<uint32_t> toVector() const;
+
+private:
+    // Больше стольких значений блок хранит битовой картой
+    static const uint32_t ARRAY_LIMIT = 4096;
+    static const size_t BITMAP_WORDS = 65536 / 64;
+    
+    struct Container {
+        uint16_t key = 0;
+        uint32_t count = 0;
+        vector<uint16_t> values;    // разреженный блок
+        vector<uint64_t> words;     // плотный блок, BITMAP_WORDS слов
+        
+        bool isBitmap() const { return !words.empty(); }
+        bool contains(uint16_t low) const;
+        void toBitmap();
+        void toArray();
+    };
+    
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    
+    Container* find(uint16_t key);
+    const Container* find(uint16_t key) const;
+    
+    vector<Container> containers_;  // по возрастанию key
+};
+
+template <typename Visit>
+void RecipeBitmap::forEach(Visit visit) const {
+    for (const auto& container : containers_) {
+        uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        
+        if (!container.isBitmap()) {
+            for (uint16_t low : container.values) {
+                visit(high | low);
+            }
+            continue;
+        }
+        
+        for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+            uint64_t word = container.words[i];
+            while (word) {
+                uint32_t bit = static_cast<uint32_t>(__builtin_ctzll(word));
+                visit(high | static_cast<uint32_t>(i * 64 + bit));
+                word &= word - 1;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "recipecache.h"
+#include <algorithm>
+
+using namespace std;
+
+RecipeCache::RecipeCache(size_t capacity)
+    : capacity_(max<size_t>(capacity, 1)), tracking_(false), epoch_(0) {
+    entries_.reserve(capacity_);
+}
+
+shared_ptr<Recipe> RecipeCache::find(int id, int* checkVersion, int* version) {
+    lock_guard<mutex> lock(mutex_);
+    *checkVersion = 0;
+    
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    
+    Entry& entry = it->second;
+    touch(entry);
+    
+    if (tracking_ && entry.epoch == epoch_) {
+        ++stats_.hits;
+    } else {
+        ++stats_.checks;
+        *checkVersion = entry.version;
+    }
+    if (version) {
+        *version = entry.version;
+    }
+    
+    // Вызывающий может менять рецепт, запись кэша остается нетронутой
+    return make_shared<Recipe>(entry.recipe);
+}
+
+void RecipeCache::put(const Recipe& recipe, int version) {
+    lock_guard<mutex> lock(mutex_);
+    
+    auto it = entries_.find(recipe.getId());
+    if (it != entries_.end()) {
+        // Запоздавшее чтение не затирает запись, сделанную после него: уведомление
+        // о своей записи кэш пропускает, и старый рецепт считался бы верным
+        if (it->second.version > version) {
+            touch(it->second);
+            return;
+        }
+        it->second.recipe = recipe;
+        it->second.version = version;
+        it->second.epoch = epoch_;
+        touch(it->second);
+        return;
+    }
+    
+    if (entries_.size() >= capacity_) {
+        entries_.erase(useOrder_.back());
+        useOrder_.pop_back();
+        ++stats_.evictions;
+    }
+    
+    useOrder_.push_front(recipe.getId());
+    entries_.emplace(recipe.getId(), Entry{recipe, version, epoch_, useOrder_.begin()});
+}
+
+void RecipeCache::erase(int id) {
+    lock_guard<mutex> lock(mutex_);
+    
+    auto it = entries_.find(id);
+    if (it == entries_.end()) return;
+    
+    useOrder_.erase(it->second.use);
+    entries_.erase(it);
+}
+
+void RecipeCache::clear() {
+    lock_guard<mutex> lock(mutex_);
+    entries_.clear();
+    useOrder_.clear();
+}
+
+void RecipeCache::invalidate(int id, int senderPid) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (ownBackends_.count(senderPid)) return;
+    }
+    erase(id);
+}
+
+void RecipeCache::invalidateAll(int senderPid) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (ownBackends_.count(senderPid)) return;
+    }
+    clear();
+}
+
+void RecipeCache::addOwnBackend(int pid) {
+    if (pid == 0) return;
+    
+    lock_guard<mutex> lock(mutex_);
+    ownBackends_.insert(pid);
+}
+
+void RecipeCache::removeOwnBackend(int pid) {
+    lock_guard<mutex> lock(mutex_);
+    ownBackends_.erase(pid);
+}
+
+void RecipeCache::setTracking(bool tracking) {
+    lock_guard<mutex> lock(mutex_);
+    tracking_ = tracking;
+    ++epoch_;
+}
+
+RecipeCache::Stats RecipeCache::stats() const {
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
+
+size_t RecipeCache::size() const {
+    lock_guard<mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void RecipeCache::touch(Entry& entry) {
+    useOrder_.splice(useOrder_.begin(), useOrder_, entry.use);
+}
\ No newline at end of file
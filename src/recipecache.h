@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "recipe.h"
+using namespace std;
+
+// Кэш полностью загруженных рецептов по id с вытеснением давно не читанных.
+// Запись сквозная: сохраненный рецепт сразу кладется в кэш с новой версией.
+// Пока соединение с подпиской на уведомления живо (tracking), чужие изменения
+// удаляют записи, и попадание обходится без сети. Записи, положенные до обрыва
+// подписки, сверяются с базой по версии строки. Общий для всех соединений
+// приложения, поэтому защищен мьютексом
+class RecipeCache {
+public:
+    struct Stats {
+        size_t hits = 0;        // отдано без обращения к серверу
+        size_t checks = 0;      // запись есть, но версию пришлось сверить
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+    
+    explicit RecipeCache(size_t capacity = 256);
+    
+    // Копия рецепта или nullptr. Если запись нужно сверить с базой,
+    // в checkVersion пишется ее версия, иначе 0; в version — версия в любом случае
+    shared_ptr<Recipe> find(int id, int* checkVersion, int* version = nullptr);
+    // Рецепт, только что прочитанный или записанный в базу с версией version;
+    // запись с более новой версией остается на месте
+    void put(const Recipe& recipe, int version);
+    void erase(int id);
+    void clear();
+    
+    // Уведомление об изменении: записи своих соединений уже положены в кэш
+    void invalidate(int id, int senderPid);
+    void invalidateAll(int senderPid);
+    
+    // Своими считаются записи соединений, которые пишут через этот кэш
+    void addOwnBackend(int pid);
+    void removeOwnBackend(int pid);
+    
+    // Подписка на уведомления началась или прервалась; в обоих случаях
+    // прежние записи могли пропустить изменения и требуют сверки
+    void setTracking(bool tracking);
+    
+    Stats stats() const;
+    size_t size() const;
+
+private:
+    struct Entry {
+        Recipe recipe;
+        int version;
+        unsigned epoch;         // эпоха подписки, в которой запись была верна
+        list<int>::iterator use;
+    };
+    
+    void touch(Entry& entry);
+    
+    const size_t capacity_;
+    unordered_map<int, Entry> entries_;
+    list<int> useOrder_;            // от недавно прочитанных к давним
+    unordered_set<int> ownBackends_;
+    bool tracking_;
+    unsigned epoch_;
+    Stats stats_;
+    mutable mutex mutex_;
+};
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include <QMessageBox>
 #include <QInputDialog>
 using namespace std;
-RecipeDialog::RecipeDialog(CookBookDatabase* db, Mode mode, QWidget *parent)
+RecipeDialog::RecipeDialog(AsyncRecipeRepository* db, Mode mode, QWidget *parent)
     : QDialog(parent), ui(new Ui::RecipeDialog), database_(db), mode_(mode), currentRecipeId_(-1) {
     
     ui->setupUi(this);
@@ -49,10 +49,15 @@ void RecipeDialog::setupConnections() {
 void RecipeDialog::loadAvailableTags() {
     ui->availableTagsList->clear();
     if (database_) {
-        auto tags = database_->getAllTags();
-        for (const auto& tag : tags) {
-            ui->availableTagsList->addItem(QString::fromStdString(tag));
-        }
+        // Список придет позже; пользователь тем временем мог добавить новый тег
+        database_->getAllTags(this, [this](vector<string> tags) {
+            for (const auto& tag : tags) {
+                QString name = QString::fromStdString(tag);
+                if (ui->availableTagsList->findItems(name, Qt::MatchExactly).isEmpty()) {
+                    ui->availableTagsList->addItem(name);
+                }
+            }
+        });
     }
 }
 
@@ -2,7 +2,7 @@
 #include <QDialog>
 #include <QStandardItemModel>
 #include "recipe.h"
-#include "cookbookdatabase.h"
+#include "asyncreciperepository.h"
 using namespace std;
 namespace Ui {
 class RecipeDialog;
@@ -14,7 +14,7 @@ class RecipeDialog : public QDialog {
 public:
     enum Mode { Create, Edit };
     
-    explicit RecipeDialog(CookBookDatabase* db, Mode mode = Create, QWidget *parent = nullptr);
+    explicit RecipeDialog(AsyncRecipeRepository* db, Mode mode = Create, QWidget *parent = nullptr);
     ~RecipeDialog();
     
     void setRecipe(const Recipe& recipe);
@@ -36,7 +36,7 @@ private:
     bool validateForm();
     
     Ui::RecipeDialog *ui;
-    CookBookDatabase* database_;
+    AsyncRecipeRepository* database_;
     Mode mode_;
     int currentRecipeId_;
     QStandardItemModel* ingredientsModel_;
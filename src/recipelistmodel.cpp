@@ -0,0 +1,446 @@
+#include "recipelistmodel.h"
+#include "asyncreciperepository.h"
+#include "recipe.h"
+#include "recipesnapshot.h"
+#include "textfold.h"
+#include <algorithm>
+using namespace std;
+
+// Страница чуть больше высоты окна: первая отрисовка не ждет остальной книги
+static const int RECIPE_PAGE_SIZE = 100;
+
+void RecipeListModel::TextColumn::clear() {
+    bytes.clear();
+    offsets.clear();
+    lengths.clear();
+}
+
+void RecipeListModel::TextColumn::append(string_view text) {
+    offsets.push_back(static_cast<uint32_t>(bytes.size()));
+    lengths.push_back(static_cast<uint32_t>(text.size()));
+    bytes.append(text.data(), text.size());
+}
+
+void RecipeListModel::TextColumn::set(size_t row, const string& text) {
+    if (text.size() <= lengths[row]) {
+        bytes.replace(offsets[row], text.size(), text);
+    } else {
+        offsets[row] = static_cast<uint32_t>(bytes.size());
+        bytes += text;
+    }
+    lengths[row] = static_cast<uint32_t>(text.size());
+}
+
+QString RecipeListModel::TextColumn::at(size_t row) const {
+    return QString::fromUtf8(bytes.data() + offsets[row], lengths[row]);
+}
+
+string_view RecipeListModel::TextColumn::view(size_t row) const {
+    return string_view(bytes.data() + offsets[row], lengths[row]);
+}
+
+RecipeListModel::RecipeListModel(AsyncRecipeRepository* database, QObject* parent)
+    : QAbstractListModel(parent), database_(database), filterMode_(TagIndex::MatchAll),
+      paged_(false), fetching_(false), exhausted_(true), resetPending_(false), generation_(0),
+      snapshot_(nullptr), snapshotRow_(0), snapshotMode_(TagIndex::MatchAll) {}
+
+void RecipeListModel::loadPages(const RecipeFilter& filter, function<void(bool)> firstPage) {
+    ++generation_;
+    paged_ = true;
+    fetching_ = false;
+    exhausted_ = false;
+    resetPending_ = true;
+    filter_ = filter;
+    lastKey_ = RecipeKey();
+    firstPage_ = move(firstPage);
+    snapshot_ = nullptr;
+    
+    fetchMore(QModelIndex());
+}
+
+void RecipeListModel::loadSnapshot(const RecipeSnapshot* snapshot, const string& search, const vector<string>& tags,
+                                   TagIndex::Mode mode, function<void(bool)> firstPage) {
+    ++generation_;
+    paged_ = true;
+    fetching_ = false;
+    exhausted_ = false;
+    resetPending_ = true;
+    filter_ = RecipeFilter();
+    lastKey_ = RecipeKey();
+    firstPage_ = move(firstPage);
+    
+    snapshot_ = snapshot;
+    snapshotRow_ = 0;
+    snapshotSearch_ = search;
+    snapshotMode_ = mode;
+    
+    // Теги переводятся в номера снимка один раз; тега нет в снимке — для "всех"
+    // список пуст, для "любого" тег просто не в счет
+    snapshotTags_.clear();
+    for (const auto& tag : tags) {
+        long number = snapshot->tagOf(tag);
+        if (number >= 0) {
+            snapshotTags_.push_back(number);
+        } else if (mode == TagIndex::MatchAll) {
+            snapshotRow_ = snapshot->size();
+        }
+    }
+    if (mode == TagIndex::MatchAny && !tags.empty() && snapshotTags_.empty()) {
+        snapshotRow_ = snapshot->size();
+    }
+    
+    fetchMore(QModelIndex());
+}
+
+void RecipeListModel::setRecipes(const vector<RecipeListEntry>& entries) {
+    // Недочитанная подгрузка больше не нужна
+    ++generation_;
+    snapshot_ = nullptr;
+    paged_ = false;
+    fetching_ = false;
+    exhausted_ = true;
+    resetPending_ = false;
+    firstPage_ = nullptr;
+    
+    beginResetModel();
+    clearRows();
+    for (const auto& entry : entries) {
+        order_.push_back(appendRow(entry.id, entry.name, entry.tags, entry.toolTip));
+    }
+    refilter();
+    endResetModel();
+}
+
+void RecipeListModel::setTagFilter(const vector<string>& tags, TagIndex::Mode mode) {
+    filterTags_ = tags;
+    filterMode_ = mode;
+    
+    beginResetModel();
+    refilter();
+    endResetModel();
+}
+
+bool RecipeListModel::applyChange(const RecipeChange& change) {
+    auto it = rowById_.find(change.id);
+    
+    switch (change.kind) {
+    case RecipeChange::Inserted:
+        return insertRecipe(change);
+    case RecipeChange::Updated:
+        // Рецепт, которого еще нет в списке, мог переименованием попасть в загруженную
+        // часть. Выдачу поиска из-за правки чужого ей рецепта не перезапрашиваем
+        if (it == rowById_.end()) return !paged_ || insertRecipe(change);
+        return updateRecipe(it->second, change);
+    case RecipeChange::Removed:
+        return it == rowById_.end() || removeRecipe(it->second);
+    }
+    return true;
+}
+
+int RecipeListModel::recipeId(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= static_cast<int>(visible_.size())) return -1;
+    return ids_[visible_[index.row()]];
+}
+
+int RecipeListModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(visible_.size());
+}
+
+QVariant RecipeListModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= static_cast<int>(visible_.size())) return QVariant();
+    
+    size_t row = visible_[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return names_.at(row);
+    case Qt::ToolTipRole:
+        return toolTips_.lengths[row] ? QVariant(toolTips_.at(row)) : QVariant();
+    case RecipeIdRole:
+        return ids_[row];
+    default:
+        return QVariant();
+    }
+}
+
+bool RecipeListModel::canFetchMore(const QModelIndex& parent) const {
+    return !parent.isValid() && paged_ && !fetching_ && !exhausted_;
+}
+
+void RecipeListModel::fetchMore(const QModelIndex& parent) {
+    if (!canFetchMore(parent)) return;
+    
+    if (snapshot_) {
+        fetchSnapshotPage();
+        return;
+    }
+    
+    fetching_ = true;
+    int generation = generation_;
+    database_->queryRecipes(filter_, lastKey_, RECIPE_PAGE_SIZE, this,
+                            [this, generation](vector<shared_ptr<Recipe>> page) {
+        if (generation != generation_) return;
+        
+        // Пустая страница при оборванном соединении — ошибка, а не конец списка
+        bool ok = !page.empty() || database_->isReady();
+        fetching_ = false;
+        exhausted_ = page.size() < static_cast<size_t>(RECIPE_PAGE_SIZE);
+        if (!page.empty()) {
+            lastKey_ = RecipeKey{page.back()->getName(), page.back()->getId()};
+        }
+        
+        appendPage(page);
+        finishPage(ok);
+    });
+}
+
+void RecipeListModel::fetchSnapshotPage() {
+    // Просматриваются записи до первой полной страницы совпадений; в модель
+    // попадают только они, остальные остаются в отображенном файле
+    vector<size_t> rows;
+    while (snapshotRow_ < snapshot_->size() && rows.size() < static_cast<size_t>(RECIPE_PAGE_SIZE)) {
+        size_t row = snapshotRow_++;
+        if (snapshotMatches(row)) {
+            rows.push_back(row);
+        }
+    }
+    
+    exhausted_ = snapshotRow_ >= snapshot_->size();
+    if (!rows.empty()) {
+        lastKey_ = RecipeKey{string(snapshot_->name(rows.back())), snapshot_->id(rows.back())};
+    }
+    
+    appendRows(rows.size(), [this, &rows](size_t i) {
+        size_t row = rows[i];
+        return appendRow(snapshot_->id(row), snapshot_->name(row), snapshot_->tags(row), string());
+    });
+    finishPage(true);
+}
+
+bool RecipeListModel::snapshotMatches(size_t row) const {
+    if (!snapshotTags_.empty()) {
+        auto has = [this, row](long tag) { return snapshot_->hasTag(row, tag); };
+        bool tagged = snapshotMode_ == TagIndex::MatchAll
+            ? all_of(snapshotTags_.begin(), snapshotTags_.end(), has)
+            : any_of(snapshotTags_.begin(), snapshotTags_.end(), has);
+        if (!tagged) return false;
+    }
+    
+    return snapshotSearch_.empty() ||
+           foldText(string(snapshot_->name(row))).find(snapshotSearch_) != string::npos;
+}
+
+void RecipeListModel::finishPage(bool ok) {
+    if (firstPage_) {
+        auto firstPage = move(firstPage_);
+        firstPage_ = nullptr;
+        firstPage(ok);
+    }
+    emit pageLoaded();
+}
+
+void RecipeListModel::clearRows() {
+    ids_.clear();
+    rowById_.clear();
+    names_.clear();
+    toolTips_.clear();
+    tagIndex_.clear();
+    order_.clear();
+    visible_.clear();
+}
+
+uint32_t RecipeListModel::appendRow(int id, string_view name, const vector<string>& tags, const string& toolTip) {
+    uint32_t row = static_cast<uint32_t>(ids_.size());
+    ids_.push_back(id);
+    rowById_[id] = row;
+    names_.append(name);
+    toolTips_.append(toolTip);
+    tagIndex_.addRow(tags);
+    return row;
+}
+
+void RecipeListModel::appendPage(const vector<shared_ptr<Recipe>>& page) {
+    appendRows(page.size(), [this, &page](size_t i) {
+        const Recipe& recipe = *page[i];
+        return appendRow(recipe.getId(), recipe.getName(), recipe.getTags(), string());
+    });
+}
+
+template <typename F>
+void RecipeListModel::appendRows(size_t count, F appendNth) {
+    // Первая страница новой загрузки заменяет прежний список одним сбросом
+    if (resetPending_) {
+        resetPending_ = false;
+        beginResetModel();
+        clearRows();
+        for (size_t i = 0; i < count; ++i) {
+            order_.push_back(appendNth(i));
+        }
+        refilter();
+        endResetModel();
+        return;
+    }
+    
+    vector<uint32_t> shown;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t row = appendNth(i);
+        order_.push_back(row);
+        if (isVisible(row)) {
+            shown.push_back(row);
+        }
+    }
+    if (shown.empty()) return;
+    
+    // Вся страница вставляется одним диапазоном строк
+    int from = static_cast<int>(visible_.size());
+    beginInsertRows(QModelIndex(), from, from + static_cast<int>(shown.size()) - 1);
+    visible_.insert(visible_.end(), shown.begin(), shown.end());
+    endInsertRows();
+}
+
+void RecipeListModel::refilter() {
+    vector<uint64_t> mask = tagIndex_.filter(filterTags_, filterMode_);
+    
+    visible_.clear();
+    for (uint32_t row : order_) {
+        if (TagIndex::contains(mask, row)) {
+            visible_.push_back(row);
+        }
+    }
+}
+
+bool RecipeListModel::isVisible(size_t row) const {
+    return tagIndex_.matches(row, filterTags_, filterMode_);
+}
+
+bool RecipeListModel::insertRecipe(const RecipeChange& change) {
+    // Место в выдаче поиска или подборки определяет сервер
+    if (!paged_) return false;
+    
+    // Рецепт за последней загруженной строкой придет со своей страницей
+    if (!isLoadedKey(change.name, change.id)) return true;
+    
+    uint32_t row = appendRow(change.id, change.name, change.tags, string());
+    order_.insert(order_.begin() + sortedPosition(order_, row), row);
+    
+    if (isVisible(row)) {
+        int position = static_cast<int>(sortedPosition(visible_, row));
+        beginInsertRows(QModelIndex(), position, position);
+        visible_.insert(visible_.begin() + position, row);
+        endInsertRows();
+    }
+    return true;
+}
+
+bool RecipeListModel::updateRecipe(uint32_t row, const RecipeChange& change) {
+    // Старые позиции ищутся по старому ключу, до замены названия
+    size_t orderFrom = positionOf(order_, row);
+    size_t from = positionOf(visible_, row);
+    bool wasVisible = from < visible_.size();
+    if (orderFrom == order_.size() || wasVisible != isVisible(row)) return false;
+    
+    names_.set(row, change.name);
+    tagIndex_.setTags(row, change.tags);
+    
+    // Строка, ушедшая за последнюю загруженную, придет со своей страницей заново
+    if (paged_ && !isLoadedKey(change.name, change.id)) {
+        if (wasVisible) {
+            beginRemoveRows(QModelIndex(), static_cast<int>(from), static_cast<int>(from));
+            visible_.erase(visible_.begin() + from);
+            endRemoveRows();
+        }
+        order_.erase(order_.begin() + orderFrom);
+        tagIndex_.removeRow(row);
+        rowById_.erase(change.id);
+        return true;
+    }
+    
+    // В выдаче поиска строка остается на месте, в списке — переезжает по новому названию
+    order_.erase(order_.begin() + orderFrom);
+    size_t orderTo = paged_ ? sortedPosition(order_, row) : orderFrom;
+    order_.insert(order_.begin() + orderTo, row);
+    
+    bool nowVisible = isVisible(row);
+    size_t to = 0;
+    if (nowVisible) {
+        if (wasVisible) visible_.erase(visible_.begin() + from);
+        to = paged_ ? sortedPosition(visible_, row)
+                    : static_cast<size_t>(count_if(order_.begin(), order_.begin() + orderTo,
+                                                   [this](uint32_t other) { return isVisible(other); }));
+        if (wasVisible) visible_.insert(visible_.begin() + from, row);
+    }
+    
+    if (wasVisible && nowVisible) {
+        if (to != from) {
+            // Номер назначения считается по списку до переноса
+            beginMoveRows(QModelIndex(), static_cast<int>(from), static_cast<int>(from),
+                          QModelIndex(), static_cast<int>(to > from ? to + 1 : to));
+            visible_.erase(visible_.begin() + from);
+            visible_.insert(visible_.begin() + to, row);
+            endMoveRows();
+        }
+        emit dataChanged(index(static_cast<int>(to)), index(static_cast<int>(to)));
+    } else if (wasVisible) {
+        beginRemoveRows(QModelIndex(), static_cast<int>(from), static_cast<int>(from));
+        visible_.erase(visible_.begin() + from);
+        endRemoveRows();
+    } else if (nowVisible) {
+        beginInsertRows(QModelIndex(), static_cast<int>(to), static_cast<int>(to));
+        visible_.insert(visible_.begin() + to, row);
+        endInsertRows();
+    }
+    return true;
+}
+
+bool RecipeListModel::removeRecipe(uint32_t row) {
+    size_t orderPosition = positionOf(order_, row);
+    size_t position = positionOf(visible_, row);
+    if (orderPosition == order_.size() || (position < visible_.size()) != isVisible(row)) return false;
+    
+    if (position < visible_.size()) {
+        beginRemoveRows(QModelIndex(), static_cast<int>(position), static_cast<int>(position));
+        visible_.erase(visible_.begin() + position);
+        endRemoveRows();
+    }
+    
+    // Номер строки остается занятым, строка просто выпадает из фильтра
+    order_.erase(order_.begin() + orderPosition);
+    tagIndex_.removeRow(row);
+    rowById_.erase(ids_[row]);
+    return true;
+}
+
+bool RecipeListModel::keyLess(uint32_t row, string_view name, int id) const {
+    // Сервер упорядочивает имена с COLLATE "C", то есть побайтово,
+    // как и string_view::compare
+    int order = names_.view(row).compare(name);
+    return order < 0 || (order == 0 && ids_[row] < id);
+}
+
+bool RecipeListModel::isLoadedKey(const string& name, int id) const {
+    // Пока не пришла первая страница новой загрузки, загруженной части еще нет
+    if (resetPending_) return false;
+    if (exhausted_) return true;
+    
+    int order = string_view(name).compare(lastKey_.name);
+    return order < 0 || (order == 0 && id <= lastKey_.id);
+}
+
+size_t RecipeListModel::sortedPosition(const vector<uint32_t>& rows, uint32_t row) const {
+    string_view name = names_.view(row);
+    int id = ids_[row];
+    auto it = lower_bound(rows.begin(), rows.end(), row, [this, name, id](uint32_t other, uint32_t) {
+        return keyLess(other, name, id);
+    });
+    return it - rows.begin();
+}
+
+size_t RecipeListModel::positionOf(const vector<uint32_t>& rows, uint32_t row) const {
+    // Постраничный список упорядочен по ключу — место ищется двоичным поиском;
+    // выдача поиска короткая и идет по релевантности — перебором.
+    // Строки нет — возвращается rows.size()
+    if (paged_) {
+        size_t position = sortedPosition(rows, row);
+        return position < rows.size() && rows[position] == row ? position : rows.size();
+    }
+    return find(rows.begin(), rows.end(), row) - rows.begin();
+}
\ No newline at end of file
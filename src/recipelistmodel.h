@@ -0,0 +1,141 @@
+#pragma once
+#include <QAbstractListModel>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "reciperepository.h"
+#include "tagindex.h"
+using namespace std;
+
+class AsyncRecipeRepository;
+class RecipeSnapshot;
+
+// Строка списка, заданного целиком: выдача поиска или подборки
+struct RecipeListEntry {
+    int id = 0;
+    string name;
+    vector<string> tags;
+    string toolTip;
+};
+
+// Модель списка рецептов для QListView. Строки хранятся по столбцам — id,
+// названия в общем буфере, теги в TagIndex, — без объекта и QVariant на строку.
+// Обычный список подгружается страницами по ключу (name, id), когда представление
+// докручено до конца, поэтому память и время до первой отрисовки зависят от
+// высоты окна, а не от размера книги. Видимы только строки, подходящие под фильтр тегов
+class RecipeListModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum Roles {
+        RecipeIdRole = Qt::UserRole
+    };
+    
+    explicit RecipeListModel(AsyncRecipeRepository* database, QObject* parent = nullptr);
+    
+    // Постраничный список по filter. Прежние строки остаются на экране, пока не
+    // придет первая страница; после нее вызывается firstPage
+    void loadPages(const RecipeFilter& filter, function<void(bool)> firstPage = {});
+    // Тот же постраничный список из снимка каталога: строки читаются из отображенного
+    // файла по номерам записей, только когда представление их просит. search —
+    // подстрока названия после foldText. snapshot должен жить, пока модель его показывает
+    void loadSnapshot(const RecipeSnapshot* snapshot, const string& search, const vector<string>& tags,
+                      TagIndex::Mode mode, function<void(bool)> firstPage = {});
+    // Список целиком, без подгрузки
+    void setRecipes(const vector<RecipeListEntry>& entries);
+    
+    void setTagFilter(const vector<string>& tags, TagIndex::Mode mode);
+    
+    // Изменение после записи рецепта: строка вставляется, переносится или
+    // удаляется на своем месте в порядке (name, id), поиск по ключу двоичный.
+    // false — новый рецепт нельзя поставить в выдачу поиска или строка не нашлась
+    // на своем месте; список нужно перезапросить.
+    // Правка рецепта, которого нет в выдаче, ее не меняет
+    bool applyChange(const RecipeChange& change);
+    
+    int recipeId(const QModelIndex& index) const;
+    bool isPaged() const { return paged_; }
+    bool hasMore() const { return paged_ && !exhausted_; }
+    
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+signals:
+    // Пришла очередная страница постраничного списка
+    void pageLoaded();
+
+private:
+    // Строки столбца лежат подряд в одном буфере; измененная строка дописывается
+    // в конец, старые байты остаются до следующей замены списка
+    struct TextColumn {
+        string bytes;
+        vector<uint32_t> offsets;
+        vector<uint32_t> lengths;
+        
+        void clear();
+        void append(string_view text);
+        void set(size_t row, const string& text);
+        QString at(size_t row) const;
+        string_view view(size_t row) const;
+    };
+    
+    void clearRows();
+    uint32_t appendRow(int id, string_view name, const vector<string>& tags, const string& toolTip);
+    void appendPage(const vector<shared_ptr<Recipe>>& page);
+    // Добавляет count строк; appendNth(i) кладет i-ю строку в столбцы и возвращает ее номер
+    template <typename F>
+    void appendRows(size_t count, F appendNth);
+    void fetchSnapshotPage();
+    bool snapshotMatches(size_t row) const;
+    void finishPage(bool ok);
+    void refilter();
+    bool isVisible(size_t row) const;
+    
+    bool insertRecipe(const RecipeChange& change);
+    // false — строки нет там, где ее ищет ключ; список ничем не изменен
+    bool updateRecipe(uint32_t row, const RecipeChange& change);
+    bool removeRecipe(uint32_t row);
+    
+    // Порядок строк: по ключу (name, id) в постраничном списке, как пришли — в выдаче поиска
+    bool keyLess(uint32_t row, string_view name, int id) const;
+    bool isLoadedKey(const string& name, int id) const;
+    size_t sortedPosition(const vector<uint32_t>& rows, uint32_t row) const;
+    size_t positionOf(const vector<uint32_t>& rows, uint32_t row) const;
+    
+    AsyncRecipeRepository* database_;
+    
+    // Столбцы загруженных строк; номер строки совпадает с номером в tagIndex_
+    vector<int> ids_;
+    unordered_map<int, uint32_t> rowById_;
+    TextColumn names_;
+    TextColumn toolTips_;
+    TagIndex tagIndex_;
+    
+    // Номера неудаленных строк в порядке показа; проходящие фильтр — строки модели
+    vector<uint32_t> order_;
+    vector<uint32_t> visible_;
+    vector<string> filterTags_;
+    TagIndex::Mode filterMode_;
+    
+    // Состояние подгрузки; ответы прежних загрузок отбрасываются по generation_
+    bool paged_;
+    bool fetching_;
+    bool exhausted_;
+    bool resetPending_;
+    int generation_;
+    RecipeFilter filter_;
+    RecipeKey lastKey_;
+    function<void(bool)> firstPage_;
+    
+    // Подгрузка из снимка: следующая непросмотренная запись и фильтр по ней
+    const RecipeSnapshot* snapshot_;
+    size_t snapshotRow_;
+    string snapshotSearch_;
+    vector<long> snapshotTags_;
+    TagIndex::Mode snapshotMode_;
+};
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+class Recipe;
+
+// Какие дочерние таблицы загружать вместе со списком рецептов
+enum RecipeParts {
+    RecipeSummary = 0,
+    RecipeIngredients = 1 << 0,
+    RecipeSteps = 1 << 1,
+    RecipeTags = 1 << 2,
+    RecipeFull = RecipeIngredients | RecipeSteps | RecipeTags
+};
+
+// Условия выборки списка рецептов; пустые поля и нули не ограничивают выборку
+struct RecipeFilter {
+    string nameContains;
+    vector<string> tags;          // рецепт должен иметь все перечисленные теги
+    vector<string> anyTags;       // рецепт должен иметь хотя бы один из этих тегов
+    string category;
+    string difficulty;
+    int minCookingTime = 0;
+    int maxCookingTime = 0;
+    
+    bool isEmpty() const {
+        return nameContains.empty() && tags.empty() && anyTags.empty() && category.empty() &&
+               difficulty.empty() && minCookingTime <= 0 && maxCookingTime <= 0;
+    }
+};
+
+// Позиция в списке, упорядоченном по (name, id); id <= 0 — начало списка
+struct RecipeKey {
+    string name;
+    int id = 0;
+};
+
+// Найденный рецепт: rank — ts_rank по взвешенному вектору, snippet — фрагменты
+// описания, ингредиентов и шагов с совпадениями в <b></b>
+struct RecipeSearchResult {
+    int id = 0;
+    string name;
+    float rank = 0;
+    string snippet;
+    vector<string> tags;
+};
+
+// Изменение одного рецепта после записи — чтобы список и меню тегов обновлялись
+// построчно, без перечитывания. tags отсортированы и без повторов, createdTags —
+// теги, которых до этой записи в базе не было
+struct RecipeChange {
+    enum Kind { Inserted, Updated, Removed };
+    
+    Kind kind = Updated;
+    int id = 0;
+    string name;
+    vector<string> tags;
+    vector<string> createdTags;
+};
+
+// Изменение, сделанное любым клиентом базы; приходит через LISTEN/NOTIFY.
+// senderPid — процесс сервера, выполнивший запись (см. CookBookDatabase::backendPid)
+struct ChangeNotification {
+    enum Kind { RecipeChanged, RecipeRemoved, TagsChanged };
+    
+    Kind kind = RecipeChanged;
+    int id = 0;
+    int senderPid = 0;
+};
+
+// Хранилище рецептов. Окно и фоновые задачи работают с ним, а не с libpq,
+// поэтому рядом с CookBookDatabase (PostgreSQL) может стоять MemoryRecipeRepository —
+// для замеров интерфейса и алгоритмов без сервера и для нагрузочных прогонов.
+// Ошибки — как везде: -1, false или nullptr, текст в getLastError()
+class RecipeRepository {
+public:
+    virtual ~RecipeRepository() = default;
+    
+    // Если задан change, в него записывается, что изменилось в списке рецептов.
+    // addRecipe и addRecipes проставляют рецептам выданные id
+    virtual int addRecipe(Recipe& recipe, RecipeChange* change = nullptr) = 0;
+    virtual bool addRecipes(vector<Recipe>& recipes) = 0;
+    virtual bool updateRecipe(const Recipe& recipe, RecipeChange* change = nullptr) = 0;
+    virtual bool deleteRecipe(int recipeId, RecipeChange* change = nullptr) = 0;
+    virtual shared_ptr<Recipe> getRecipeById(int id) = 0;
+    virtual vector<shared_ptr<Recipe>> getAllRecipes(int parts = RecipeSummary) = 0;
+    
+    // Страница списка с тегами в порядке (name, id) после ключа afterKey
+    virtual vector<shared_ptr<Recipe>> queryRecipes(const RecipeFilter& filter, const RecipeKey& afterKey, int limit) = 0;
+    
+    // Лучшие limit совпадений по убыванию rank; каждое слово text ищется как префикс
+    virtual vector<RecipeSearchResult> searchRecipes(const string& text, const vector<string>& tags = {},
+                                                     int limit = 50, const vector<int>& within = {}) = 0;
+    
+    // Рецепты с тегами по одному в порядке имен; consumer возвращает false, чтобы остановиться
+    virtual bool forEachRecipe(const function<bool(Recipe&&)>& consumer) = 0;
+    
+    // Все теги по имени, в том числе уже без рецептов
+    virtual vector<string> getAllTags() = 0;
+    
+    // id -> версия рецепта; версия растет при каждой записи
+    virtual bool getRecipeVersions(unordered_map<int, int>& versions) = 0;
+    
+    virtual string getLastError() const = 0;
+};
\ No newline at end of file
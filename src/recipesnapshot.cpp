@@ -0,0 +1,481 @@
+#include "recipesnapshot.h"
+#include "reciperepository.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+// Последний байт — версия формата: старый снимок после ее смены просто не открывается
+const char SNAPSHOT_MAGIC[8] = {'C', 'B', 'S', 'N', 'A', 'P', '\0', '\1'};
+
+// Больше стольких новых и измененных рецептов проще перечитать каталог целиком
+const size_t SNAPSHOT_DELTA_LIMIT = 200;
+
+size_t align8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+}
+
+struct RecipeSnapshot::StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct RecipeSnapshot::Header {
+    char magic[8];
+    uint32_t recipeCount;
+    uint32_t ingredientCount;
+    uint32_t stepCount;
+    uint32_t tagCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t recipesOffset;
+    uint64_t idIndexOffset;
+    uint64_t ingredientsOffset;
+    uint64_t stepsOffset;
+    uint64_t tagNamesOffset;
+    uint64_t tagBitsOffset;
+    uint64_t fileSize;
+};
+
+struct RecipeSnapshot::RecipeRecord {
+    int32_t id;
+    int32_t version;
+    int32_t cookingTime;
+    uint32_t firstIngredient;
+    uint32_t ingredientCount;
+    uint32_t firstStep;
+    uint32_t stepCount;
+    StringRef name;
+    StringRef description;
+    StringRef difficulty;
+    StringRef category;
+};
+
+struct RecipeSnapshot::IngredientRecord {
+    StringRef name;
+    StringRef quantity;
+    StringRef unit;
+};
+
+struct RecipeSnapshot::StepRecord {
+    int32_t number;
+    StringRef description;
+};
+
+RecipeSnapshot::~RecipeSnapshot() {
+    close();
+}
+
+bool RecipeSnapshot::open(const string& path) {
+    close();
+    
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    
+    // Отображение остается действительным и после закрытия дескриптора
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+    
+    data_ = static_cast<const char*>(mapped);
+    length_ = info.st_size;
+    
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void RecipeSnapshot::close() {
+    if (data_) {
+        munmap(const_cast<char*>(data_), length_);
+    }
+    data_ = nullptr;
+    length_ = 0;
+}
+
+bool RecipeSnapshot::validate() const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return false;
+    if (header.fileSize != length_) return false;
+    
+    // Секция должна лежать в файле целиком и быть выровнена под свои записи
+    auto fits = [this](uint64_t offset, uint64_t count, uint64_t itemSize) {
+        return offset % 8 == 0 && offset <= length_ && count <= (length_ - offset) / itemSize;
+    };
+    
+    if (!fits(header.stringsOffset, header.stringsSize, 1) ||
+        !fits(header.recipesOffset, header.recipeCount, sizeof(RecipeRecord)) ||
+        !fits(header.idIndexOffset, header.recipeCount, sizeof(uint32_t)) ||
+        !fits(header.ingredientsOffset, header.ingredientCount, sizeof(IngredientRecord)) ||
+        !fits(header.stepsOffset, header.stepCount, sizeof(StepRecord)) ||
+        !fits(header.tagNamesOffset, header.tagCount, sizeof(StringRef)) ||
+        !fits(header.tagBitsOffset, static_cast<uint64_t>(header.tagCount) * wordsPerTag(), sizeof(uint64_t))) {
+        return false;
+    }
+    
+    // Все ссылки проверяются один раз здесь, чтобы чтение обходилось без проверок
+    auto validText = [&header](const StringRef& ref) {
+        return ref.offset <= header.stringsSize && ref.length <= header.stringsSize - ref.offset;
+    };
+    
+    const RecipeRecord* records = reinterpret_cast<const RecipeRecord*>(data_ + header.recipesOffset);
+    for (uint32_t i = 0; i < header.recipeCount; ++i) {
+        const RecipeRecord& r = records[i];
+        if (!validText(r.name) || !validText(r.description) || !validText(r.difficulty) || !validText(r.category)) {
+            return false;
+        }
+        if (r.firstIngredient > header.ingredientCount || r.ingredientCount > header.ingredientCount - r.firstIngredient ||
+            r.firstStep > header.stepCount || r.stepCount > header.stepCount - r.firstStep) {
+            return false;
+        }
+    }
+    
+    const uint32_t* idIndex = reinterpret_cast<const uint32_t*>(data_ + header.idIndexOffset);
+    for (uint32_t i = 0; i < header.recipeCount; ++i) {
+        if (idIndex[i] >= header.recipeCount) return false;
+        if (i > 0 && records[idIndex[i - 1]].id >= records[idIndex[i]].id) return false;
+    }
+    
+    const IngredientRecord* ingredients = reinterpret_cast<const IngredientRecord*>(data_ + header.ingredientsOffset);
+    for (uint32_t i = 0; i < header.ingredientCount; ++i) {
+        if (!validText(ingredients[i].name) || !validText(ingredients[i].quantity) || !validText(ingredients[i].unit)) {
+            return false;
+        }
+    }
+    
+    const StepRecord* steps = reinterpret_cast<const StepRecord*>(data_ + header.stepsOffset);
+    for (uint32_t i = 0; i < header.stepCount; ++i) {
+        if (!validText(steps[i].description)) return false;
+    }
+    
+    const StringRef* tagNames = reinterpret_cast<const StringRef*>(data_ + header.tagNamesOffset);
+    for (uint32_t i = 0; i < header.tagCount; ++i) {
+        if (!validText(tagNames[i])) return false;
+    }
+    
+    // Биты за последней записью должны быть пустыми, иначе обход тега выйдет за список
+    size_t tail = header.recipeCount % 64;
+    if (tail != 0) {
+        uint64_t extra = ~((uint64_t(1) << tail) - 1);
+        for (uint32_t tag = 0; tag < header.tagCount; ++tag) {
+            if (tagWords(tag)[wordsPerTag() - 1] & extra) return false;
+        }
+    }
+    
+    return true;
+}
+
+size_t RecipeSnapshot::size() const {
+    return data_ ? reinterpret_cast<const Header*>(data_)->recipeCount : 0;
+}
+
+int RecipeSnapshot::id(size_t row) const {
+    return record(row).id;
+}
+
+int RecipeSnapshot::version(size_t row) const {
+    return record(row).version;
+}
+
+string_view RecipeSnapshot::name(size_t row) const {
+    return text(record(row).name);
+}
+
+long RecipeSnapshot::rowOf(int id) const {
+    if (!data_) return -1;
+    
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    const uint32_t* first = reinterpret_cast<const uint32_t*>(data_ + header.idIndexOffset);
+    const uint32_t* last = first + header.recipeCount;
+    
+    auto it = lower_bound(first, last, id, [this](uint32_t row, int value) { return record(row).id < value; });
+    if (it == last || record(*it).id != id) return -1;
+    return static_cast<long>(*it);
+}
+
+Recipe RecipeSnapshot::recipe(size_t row) const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    const RecipeRecord& r = record(row);
+    
+    Recipe recipe{string(text(r.name)), string(text(r.description))};
+    recipe.setId(r.id);
+    recipe.setCookingTime(r.cookingTime);
+    recipe.setDifficulty(string(text(r.difficulty)));
+    recipe.setCategory(string(text(r.category)));
+    
+    const IngredientRecord* ingredients = reinterpret_cast<const IngredientRecord*>(data_ + header.ingredientsOffset);
+    for (uint32_t i = 0; i < r.ingredientCount; ++i) {
+        const IngredientRecord& ing = ingredients[r.firstIngredient + i];
+        recipe.addIngredient(Ingredient(string(text(ing.name)), string(text(ing.quantity)), string(text(ing.unit))));
+    }
+    
+    const StepRecord* steps = reinterpret_cast<const StepRecord*>(data_ + header.stepsOffset);
+    for (uint32_t i = 0; i < r.stepCount; ++i) {
+        const StepRecord& step = steps[r.firstStep + i];
+        recipe.addStep(CookingStep(step.number, string(text(step.description))));
+    }
+    
+    for (auto& tag : tags(row)) {
+        recipe.addTag(move(tag));
+    }
+    
+    return recipe;
+}
+
+vector<string> RecipeSnapshot::tags(size_t row) const {
+    vector<string> names;
+    for (size_t tag = 0; tag < tagCount(); ++tag) {
+        if (hasTag(row, tag)) {
+            names.emplace_back(tagName(tag));
+        }
+    }
+    return names;
+}
+
+size_t RecipeSnapshot::tagCount() const {
+    return data_ ? reinterpret_cast<const Header*>(data_)->tagCount : 0;
+}
+
+string_view RecipeSnapshot::tagName(size_t tag) const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    return text(reinterpret_cast<const StringRef*>(data_ + header.tagNamesOffset)[tag]);
+}
+
+long RecipeSnapshot::tagOf(string_view name) const {
+    // Имена тегов записаны по возрастанию байтов
+    size_t first = 0;
+    size_t last = tagCount();
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (tagName(middle) < name) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first < tagCount() && tagName(first) == name ? static_cast<long>(first) : -1;
+}
+
+bool RecipeSnapshot::hasTag(size_t row, size_t tag) const {
+    return tagWords(tag)[row / 64] & (uint64_t(1) << (row % 64));
+}
+
+string_view RecipeSnapshot::text(const StringRef& ref) const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    return string_view(data_ + header.stringsOffset + ref.offset, ref.length);
+}
+
+const RecipeSnapshot::RecipeRecord& RecipeSnapshot::record(size_t row) const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    return reinterpret_cast<const RecipeRecord*>(data_ + header.recipesOffset)[row];
+}
+
+const uint64_t* RecipeSnapshot::tagWords(size_t tag) const {
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    return reinterpret_cast<const uint64_t*>(data_ + header.tagBitsOffset) + tag * wordsPerTag();
+}
+
+size_t RecipeSnapshot::wordsPerTag() const {
+    return (size() + 63) / 64;
+}
+
+bool RecipeSnapshot::write(const string& path, const vector<shared_ptr<Recipe>>& recipes,
+                           const unordered_map<int, int>& versions) {
+    // Записи в порядке списка: по байтам названия, затем по id
+    vector<const Recipe*> rows;
+    rows.reserve(recipes.size());
+    for (const auto& recipe : recipes) {
+        rows.push_back(recipe.get());
+    }
+    sort(rows.begin(), rows.end(), [](const Recipe* a, const Recipe* b) {
+        int order = a->getName().compare(b->getName());
+        return order < 0 || (order == 0 && a->getId() < b->getId());
+    });
+    
+    // Категории, сложность, единицы и теги повторяются — каждая строка хранится один раз
+    string strings;
+    unordered_map<string, StringRef> interned;
+    auto intern = [&strings, &interned](const string& value) {
+        auto it = interned.find(value);
+        if (it != interned.end()) return it->second;
+        
+        StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size())};
+        strings += value;
+        interned.emplace(value, ref);
+        return ref;
+    };
+    
+    vector<string> tagNames;
+    for (const Recipe* recipe : rows) {
+        tagNames.insert(tagNames.end(), recipe->getTags().begin(), recipe->getTags().end());
+    }
+    sort(tagNames.begin(), tagNames.end());
+    tagNames.erase(unique(tagNames.begin(), tagNames.end()), tagNames.end());
+    
+    unordered_map<string, uint32_t> tagNumbers;
+    vector<StringRef> tagRefs;
+    for (const auto& tag : tagNames) {
+        tagNumbers.emplace(tag, static_cast<uint32_t>(tagRefs.size()));
+        tagRefs.push_back(intern(tag));
+    }
+    
+    size_t words = (rows.size() + 63) / 64;
+    vector<uint64_t> tagBits(tagNames.size() * words, 0);
+    
+    vector<RecipeRecord> records;
+    vector<IngredientRecord> ingredients;
+    vector<StepRecord> steps;
+    records.reserve(rows.size());
+    
+    for (size_t row = 0; row < rows.size(); ++row) {
+        const Recipe& recipe = *rows[row];
+        auto version = versions.find(recipe.getId());
+        
+        RecipeRecord r;
+        r.id = recipe.getId();
+        r.version = version != versions.end() ? version->second : 0;
+        r.cookingTime = recipe.getCookingTime();
+        r.firstIngredient = static_cast<uint32_t>(ingredients.size());
+        r.ingredientCount = static_cast<uint32_t>(recipe.getIngredients().size());
+        r.firstStep = static_cast<uint32_t>(steps.size());
+        r.stepCount = static_cast<uint32_t>(recipe.getSteps().size());
+        r.name = intern(recipe.getName());
+        r.description = intern(recipe.getDescription());
+        r.difficulty = intern(recipe.getDifficulty());
+        r.category = intern(recipe.getCategory());
+        records.push_back(r);
+        
+        for (const auto& ing : recipe.getIngredients()) {
+            ingredients.push_back({intern(ing.getName()), intern(ing.getQuantity()), intern(ing.getUnit())});
+        }
+        for (const auto& step : recipe.getSteps()) {
+            steps.push_back({step.getStepNumber(), intern(step.getDescription())});
+        }
+        for (const auto& tag : recipe.getTags()) {
+            tagBits[tagNumbers[tag] * words + row / 64] |= uint64_t(1) << (row % 64);
+        }
+    }
+    
+    // Смещения строк 32-битные
+    if (strings.size() > UINT32_MAX) return false;
+    
+    vector<uint32_t> idIndex(rows.size());
+    for (size_t row = 0; row < rows.size(); ++row) {
+        idIndex[row] = static_cast<uint32_t>(row);
+    }
+    sort(idIndex.begin(), idIndex.end(), [&records](uint32_t a, uint32_t b) { return records[a].id < records[b].id; });
+    
+    Header header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.recipeCount = static_cast<uint32_t>(records.size());
+    header.ingredientCount = static_cast<uint32_t>(ingredients.size());
+    header.stepCount = static_cast<uint32_t>(steps.size());
+    header.tagCount = static_cast<uint32_t>(tagRefs.size());
+    
+    // Раскладка секций по порядку, каждая с границы 8 байт
+    size_t offset = align8(sizeof(Header));
+    auto place = [&offset](uint64_t& field, size_t bytes) {
+        field = offset;
+        offset = align8(offset + bytes);
+    };
+    place(header.stringsOffset, strings.size());
+    header.stringsSize = strings.size();
+    place(header.recipesOffset, records.size() * sizeof(RecipeRecord));
+    place(header.idIndexOffset, idIndex.size() * sizeof(uint32_t));
+    place(header.ingredientsOffset, ingredients.size() * sizeof(IngredientRecord));
+    place(header.stepsOffset, steps.size() * sizeof(StepRecord));
+    place(header.tagNamesOffset, tagRefs.size() * sizeof(StringRef));
+    place(header.tagBitsOffset, tagBits.size() * sizeof(uint64_t));
+    header.fileSize = offset;
+    
+    string temporary = path + ".tmp";
+    ofstream out(temporary, ios::binary | ios::trunc);
+    if (!out) return false;
+    
+    size_t written = 0;
+    auto put = [&out, &written](uint64_t at, const void* data, size_t bytes) {
+        static const char zeros[8] = {};
+        out.write(zeros, at - written);
+        out.write(static_cast<const char*>(data), bytes);
+        written = at + bytes;
+    };
+    put(0, &header, sizeof(header));
+    put(header.stringsOffset, strings.data(), strings.size());
+    put(header.recipesOffset, records.data(), records.size() * sizeof(RecipeRecord));
+    put(header.idIndexOffset, idIndex.data(), idIndex.size() * sizeof(uint32_t));
+    put(header.ingredientsOffset, ingredients.data(), ingredients.size() * sizeof(IngredientRecord));
+    put(header.stepsOffset, steps.data(), steps.size() * sizeof(StepRecord));
+    put(header.tagNamesOffset, tagRefs.data(), tagRefs.size() * sizeof(StringRef));
+    put(header.tagBitsOffset, tagBits.data(), tagBits.size() * sizeof(uint64_t));
+    put(header.fileSize, nullptr, 0);
+    
+    out.close();
+    if (!out) {
+        remove(temporary.c_str());
+        return false;
+    }
+    
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool syncRecipeSnapshot(RecipeRepository& database, const RecipeSnapshot& current, const string& path) {
+    // Версии читаются раньше рецептов: содержимое не старше записанной версии,
+    // а рецепт, измененный между запросами, просто перечитается при следующей сверке
+    unordered_map<int, int> versions;
+    if (!database.getRecipeVersions(versions)) return false;
+    
+    vector<int> changed;
+    for (const auto& [id, version] : versions) {
+        long row = current.rowOf(id);
+        if (row < 0 || current.version(row) != version) {
+            changed.push_back(id);
+        }
+    }
+    
+    size_t kept = versions.size() - changed.size();
+    if (current.isOpen() && changed.empty() && kept == current.size()) {
+        return true;
+    }
+    
+    vector<shared_ptr<Recipe>> recipes;
+    if (!current.isOpen() || changed.size() > SNAPSHOT_DELTA_LIMIT) {
+        recipes = database.getAllRecipes(RecipeFull);
+        // Пустой ответ на непустой каталог — ошибка чтения, а не удаление всего
+        if (recipes.empty() && !versions.empty()) return false;
+    } else {
+        recipes.reserve(versions.size());
+        for (size_t row = 0; row < current.size(); ++row) {
+            auto version = versions.find(current.id(row));
+            if (version != versions.end() && version->second == current.version(row)) {
+                recipes.push_back(make_shared<Recipe>(current.recipe(row)));
+            }
+        }
+        
+        for (int id : changed) {
+            auto recipe = database.getRecipeById(id);
+            // Рецепт удален после чтения версий или связь прервалась — сверим в другой раз
+            if (!recipe) return false;
+            recipes.push_back(move(recipe));
+        }
+    }
+    
+    return RecipeSnapshot::write(path, recipes, versions);
+}
\ No newline at end of file
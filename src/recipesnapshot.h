@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "recipe.h"
+using namespace std;
+
+// Снимок каталога в локальном файле: открывается через mmap и читается на месте,
+// без разбора и копирования, поэтому список виден до подключения к серверу
+// и без него. Формат (все числа в порядке байт машины, секции выровнены на 8):
+//   заголовок; таблица строк без повторов; записи рецептов по (name, id);
+//   номера записей по возрастанию id; ингредиенты и шаги подряд, рецепт
+//   ссылается на свой отрезок; имена тегов; битовая строка каждого тега
+//   по номерам записей. version каждого рецепта — для сверки с базой
+class RecipeRepository;
+
+class RecipeSnapshot {
+public:
+    RecipeSnapshot() = default;
+    ~RecipeSnapshot();
+    
+    RecipeSnapshot(const RecipeSnapshot&) = delete;
+    RecipeSnapshot& operator=(const RecipeSnapshot&) = delete;
+    
+    // Файл проверяется целиком: чужой или испорченный снимок не открывается
+    bool open(const string& path);
+    void close();
+    bool isOpen() const { return data_ != nullptr; }
+    
+    size_t size() const;
+    int id(size_t row) const;
+    int version(size_t row) const;
+    string_view name(size_t row) const;
+    // Номер записи рецепта или -1
+    long rowOf(int id) const;
+    // Рецепт целиком; строки копируются только здесь и в tags
+    Recipe recipe(size_t row) const;
+    vector<string> tags(size_t row) const;
+    
+    size_t tagCount() const;
+    string_view tagName(size_t tag) const;
+    // Номер тега или -1
+    long tagOf(string_view name) const;
+    bool hasTag(size_t row, size_t tag) const;
+    
+    // Пишет во временный файл и переименовывает, чтобы открытый снимок
+    // и снимок после сбоя записи оставались целыми
+    static bool write(const string& path, const vector<shared_ptr<Recipe>>& recipes,
+                      const unordered_map<int, int>& versions);
+
+private:
+    struct Header;
+    struct StringRef;
+    struct RecipeRecord;
+    struct IngredientRecord;
+    struct StepRecord;
+    
+    bool validate() const;
+    string_view text(const StringRef& ref) const;
+    const RecipeRecord& record(size_t row) const;
+    const uint64_t* tagWords(size_t tag) const;
+    size_t wordsPerTag() const;
+    
+    const char* data_ = nullptr;
+    size_t length_ = 0;
+};
+
+// Приводит снимок current к состоянию базы и пишет результат в path. Сначала
+// читаются версии всех рецептов, затем только новые и измененные рецепты;
+// при большом расхождении или без снимка каталог читается целиком.
+// Снимок, который уже совпадает с базой, не перезаписывается
+bool syncRecipeSnapshot(RecipeRepository& database, const RecipeSnapshot& current, const string& path);
\ No newline at end of file
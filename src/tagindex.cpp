@@ -0,0 +1,215 @@
+#include "tagindex.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TAGINDEX_AVX2 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// Пословные операции над масками одинаковой длины: dst = dst op src
+struct BitsetKernels {
+    void (*andWords)(uint64_t* dst, const uint64_t* src, size_t words);
+    void (*orWords)(uint64_t* dst, const uint64_t* src, size_t words);
+    void (*andNotWords)(uint64_t* dst, const uint64_t* src, size_t words);
+    size_t (*popcount)(const uint64_t* words, size_t count);
+};
+
+void andWordsScalar(uint64_t* dst, const uint64_t* src, size_t words) {
+    for (size_t i = 0; i < words; ++i) dst[i] &= src[i];
+}
+
+void orWordsScalar(uint64_t* dst, const uint64_t* src, size_t words) {
+    for (size_t i = 0; i < words; ++i) dst[i] |= src[i];
+}
+
+void andNotWordsScalar(uint64_t* dst, const uint64_t* src, size_t words) {
+    for (size_t i = 0; i < words; ++i) dst[i] &= ~src[i];
+}
+
+size_t popcountScalar(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) total += static_cast<size_t>(__builtin_popcountll(words[i]));
+    return total;
+}
+
+#ifdef TAGINDEX_AVX2
+
+// По 256 бит за итерацию; хвост меньше четырех слов — скалярно
+__attribute__((target("avx2")))
+void andWordsAvx2(uint64_t* dst, const uint64_t* src, size_t words) {
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_and_si256(a, b));
+    }
+    andWordsScalar(dst + i, src + i, words - i);
+}
+
+__attribute__((target("avx2")))
+void orWordsAvx2(uint64_t* dst, const uint64_t* src, size_t words) {
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(a, b));
+    }
+    orWordsScalar(dst + i, src + i, words - i);
+}
+
+__attribute__((target("avx2")))
+void andNotWordsAvx2(uint64_t* dst, const uint64_t* src, size_t words) {
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        // andnot(b, a) = ~b & a
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_andnot_si256(b, a));
+    }
+    andNotWordsScalar(dst + i, src + i, words - i);
+}
+
+// Аппаратный popcnt вместо табличной реализации по умолчанию
+__attribute__((target("popcnt")))
+size_t popcountHardware(const uint64_t* words, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) total += static_cast<size_t>(__builtin_popcountll(words[i]));
+    return total;
+}
+
+#endif
+
+BitsetKernels selectKernels() {
+    BitsetKernels kernels = {andWordsScalar, orWordsScalar, andNotWordsScalar, popcountScalar};
+
+#ifdef TAGINDEX_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.andWords = andWordsAvx2;
+        kernels.orWords = orWordsAvx2;
+        kernels.andNotWords = andNotWordsAvx2;
+    }
+    if (__builtin_cpu_supports("popcnt")) {
+        kernels.popcount = popcountHardware;
+    }
+#endif
+
+    return kernels;
+}
+
+const BitsetKernels& kernels() {
+    static const BitsetKernels selected = selectKernels();
+    return selected;
+}
+
+}
+
+void TagIndex::clear() {
+    tagIds_.clear();
+    bits_.clear();
+    live_.clear();
+    rows_ = 0;
+}
+
+int TagIndex::addRow(const vector<string>& tags) {
+    size_t row = rows_++;
+    size_t words = (rows_ + 63) / 64;
+    
+    // Маски растут по слову на каждые 64 строки
+    if (row % 64 == 0) {
+        for (auto& bits : bits_) {
+            bits.resize(words, 0);
+        }
+        live_.resize(words, 0);
+    }
+    
+    live_[row / 64] |= uint64_t(1) << (row % 64);
+    setTags(row, tags);
+    return static_cast<int>(row);
+}
+
+void TagIndex::setTags(size_t row, const vector<string>& tags) {
+    size_t word = row / 64;
+    uint64_t bit = uint64_t(1) << (row % 64);
+    
+    for (auto& bits : bits_) {
+        bits[word] &= ~bit;
+    }
+    
+    for (const auto& tag : tags) {
+        auto inserted = tagIds_.emplace(tag, bits_.size());
+        if (inserted.second) {
+            bits_.emplace_back(live_.size(), 0);
+        }
+        bits_[inserted.first->second][word] |= bit;
+    }
+}
+
+void TagIndex::removeRow(size_t row) {
+    if (row >= rows_) return;
+    
+    setTags(row, {});
+    live_[row / 64] &= ~(uint64_t(1) << (row % 64));
+}
+
+bool TagIndex::matches(size_t row, const vector<string>& tags, Mode mode) const {
+    if (row >= rows_ || !contains(live_, row)) return false;
+    if (tags.empty()) return true;
+    
+    for (const auto& tag : tags) {
+        const vector<uint64_t>* bits = bitsFor(tag);
+        bool has = bits && contains(*bits, row);
+        if (mode == MatchAll && !has) return false;
+        if (mode == MatchAny && has) return true;
+    }
+    
+    return mode == MatchAll;
+}
+
+const vector<uint64_t>* TagIndex::bitsFor(const string& tag) const {
+    auto it = tagIds_.find(tag);
+    return it != tagIds_.end() ? &bits_[it->second] : nullptr;
+}
+
+vector<uint64_t> TagIndex::filter(const vector<string>& tags, Mode mode, const vector<string>& excluded) const {
+    size_t words = (rows_ + 63) / 64;
+    const BitsetKernels& ops = kernels();
+    vector<uint64_t> mask;
+    
+    if (tags.empty() || mode == MatchAll) {
+        // Начинаем со всех неудаленных строк
+        mask = live_;
+        
+        for (const auto& tag : tags) {
+            const vector<uint64_t>* bits = bitsFor(tag);
+            if (!bits) {
+                // Тега нет ни у одной строки
+                mask.assign(words, 0);
+                return mask;
+            }
+            ops.andWords(mask.data(), bits->data(), words);
+        }
+    } else {
+        mask.assign(words, 0);
+        for (const auto& tag : tags) {
+            if (const vector<uint64_t>* bits = bitsFor(tag)) {
+                ops.orWords(mask.data(), bits->data(), words);
+            }
+        }
+    }
+    
+    for (const auto& tag : excluded) {
+        if (const vector<uint64_t>* bits = bitsFor(tag)) {
+            ops.andNotWords(mask.data(), bits->data(), words);
+        }
+    }
+    
+    return mask;
+}
+
+size_t TagIndex::count(const vector<uint64_t>& mask) {
+    return kernels().popcount(mask.data(), mask.size());
+}
\ No newline at end of file
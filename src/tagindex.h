@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+using namespace std;
+
+// Индекс тегов загруженного списка: по плотной битовой маске на тег, бит на строку.
+// Комбинации тегов считаются пословно над масками (AVX2, если процессор
+// поддерживает, иначе обычными 64-битными операциями)
+class TagIndex {
+public:
+    enum Mode {
+        MatchAll,   // есть все выбранные теги
+        MatchAny    // есть хотя бы один
+    };
+    
+    void clear();
+    
+    // Добавляет строку в конец; возвращает ее номер
+    int addRow(const vector<string>& tags);
+    void setTags(size_t row, const vector<string>& tags);
+    // Номер строки не переиспользуется, она просто перестает подходить под фильтры
+    void removeRow(size_t row);
+    size_t rowCount() const { return rows_; }
+    
+    // Маска строк, подходящих под выбранные теги и не имеющих ни одного из excluded.
+    // Пустой tags не ограничивает выборку
+    vector<uint64_t> filter(const vector<string>& tags, Mode mode, const vector<string>& excluded = {}) const;
+    
+    // Проверка одной строки без построения маски — для строк, добавленных после фильтрации
+    bool matches(size_t row, const vector<string>& tags, Mode mode) const;
+    
+    static size_t count(const vector<uint64_t>& mask);
+    static bool contains(const vector<uint64_t>& mask, size_t row) {
+        return (mask[row / 64] >> (row % 64)) & 1;
+    }
+
+private:
+    const vector<uint64_t>* bitsFor(const string& tag) const;
+    
+    unordered_map<string, size_t> tagIds_;
+    vector<vector<uint64_t>> bits_;     // по id тега
+    vector<uint64_t> live_;             // неудаленные строки
+    size_t rows_ = 0;
+};
\ No newline at end of file
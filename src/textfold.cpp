@@ -0,0 +1,81 @@
+#include "textfold.h"
+
+using namespace std;
+
+// Строчная пара буквы из двухбайтовой части UTF-8 (U+0080..U+07FF): Latin-1,
+// латиница Extended-A, греческий и весь кириллический блок. Простое
+// отображение Unicode CaseFolding, плюс "ё" как "е" и "ς" как "σ"
+static unsigned foldCodePoint(unsigned cp) {
+    // Latin-1: À-Þ, кроме знака умножения
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) return cp + 0x20;
+    
+    // Latin Extended-A: пары заглавная-строчная, сдвинутые на границах.
+    // У İ нет однобуквенной строчной пары, она остается как есть
+    if ((cp >= 0x100 && cp <= 0x137 && cp != 0x130) || (cp >= 0x14A && cp <= 0x177)) return cp | 1;
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) return cp + (cp & 1);
+    if (cp == 0x178) return 0xFF;
+    
+    // Греческий: буквы с тоном и без, конечная сигма как обычная
+    if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) return cp + 0x20;
+    if (cp == 0x386) return 0x3AC;
+    if (cp >= 0x388 && cp <= 0x38A) return cp + 0x25;
+    if (cp == 0x38C) return 0x3CC;
+    if (cp == 0x38E || cp == 0x38F) return cp + 0x3F;
+    if (cp == 0x3C2) return 0x3C3;
+    
+    // Кириллица: Ё и ё сравниваются как е
+    if (cp == 0x401 || cp == 0x451) return 0x435;
+    // Ѐ-Џ (украинские, белорусские, сербские, македонские буквы) и А-Я
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;
+    // Старые и неславянские буквы идут парами: заглавная четная, строчная за ней.
+    // Ӏ стоит отдельно, а пары Ӂ-ӎ начинаются с нечетной
+    if ((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48A && cp <= 0x4BF) || (cp >= 0x4D0 && cp <= 0x4FF)) return cp | 1;
+    if (cp == 0x4C0) return 0x4CF;
+    if (cp >= 0x4C1 && cp <= 0x4CE) return cp + (cp & 1);
+    
+    return cp;
+}
+
+string foldText(const string& text) {
+    string folded;
+    folded.reserve(text.size());
+    bool pendingSpace = false;
+    
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            pendingSpace = !folded.empty();
+            continue;
+        }
+        
+        if (pendingSpace) {
+            folded += ' ';
+            pendingSpace = false;
+        }
+        
+        if (c >= 'A' && c <= 'Z') {
+            folded += static_cast<char>(c + ('a' - 'A'));
+            continue;
+        }
+        
+        // Двухбайтовый символ: C2..DF, затем байт продолжения 80..BF.
+        // Строчная пара тоже двухбайтовая, поэтому длина текста не меняется
+        if (c >= 0xC2 && c <= 0xDF && i + 1 < text.size()) {
+            unsigned char next = static_cast<unsigned char>(text[i + 1]);
+            
+            if ((next & 0xC0) == 0x80) {
+                unsigned cp = foldCodePoint(((c & 0x1Fu) << 6) | (next & 0x3Fu));
+                folded += static_cast<char>(0xC0 | (cp >> 6));
+                folded += static_cast<char>(0x80 | (cp & 0x3F));
+                ++i;
+                continue;
+            }
+        }
+        
+        folded += static_cast<char>(c);
+    }
+    
+    return folded;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+#include <string>
+using namespace std;
+
+// Приведение текста к виду для сравнения: строчные буквы (латиница с Latin-1
+// и Extended-A, греческий, весь кириллический блок), "ё" как "е", пробелы
+// по краям убраны, подряд идущие пробельные символы сжаты в один
+string foldText(const string& text);
\ No newline at end of file
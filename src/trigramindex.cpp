@@ -0,0 +1,228 @@
+#include "trigramindex.h"
+#include "recipe.h"
+#include "textfold.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Символы слова как кодовые точки; разделители — пробел и знаки ASCII,
+// любые символы вне ASCII считаются буквами
+vector<vector<uint32_t>> splitWords(const string& text) {
+    vector<vector<uint32_t>> words(1);
+    
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        
+        if (c < 0x80) {
+            ++i;
+            if (isalnum(c)) {
+                words.back().push_back(c);
+            } else if (!words.back().empty()) {
+                words.emplace_back();
+            }
+            continue;
+        }
+        
+        // Многобайтовая последовательность UTF-8
+        int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        uint32_t codepoint = length == 1 ? c : c & (0xFF >> (length + 1));
+        for (int k = 1; k < length && i + k < text.size(); ++k) {
+            codepoint = (codepoint << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+        }
+        words.back().push_back(codepoint);
+        i += length;
+    }
+    
+    if (words.back().empty()) {
+        words.pop_back();
+    }
+    return words;
+}
+
+}
+
+void TrigramIndex::clear() {
+    entries_.clear();
+    postings_.clear();
+    recipeEntries_.clear();
+    deadEntries_ = 0;
+}
+
+vector<TrigramIndex::Trigram> TrigramIndex::trigrams(const string& text) {
+    vector<Trigram> result;
+    
+    // Слово дополняется двумя пробелами в начале и одним в конце, как в pg_trgm:
+    // так начало слова весит больше, а короткие слова тоже дают триграммы
+    for (const auto& word : splitWords(foldText(text))) {
+        vector<uint32_t> padded = {' ', ' '};
+        padded.insert(padded.end(), word.begin(), word.end());
+        padded.push_back(' ');
+        
+        for (size_t i = 0; i + 2 < padded.size(); ++i) {
+            result.push_back((Trigram(padded[i]) << 42) | (Trigram(padded[i + 1]) << 21) | padded[i + 2]);
+        }
+    }
+    
+    sort(result.begin(), result.end());
+    result.erase(unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void TrigramIndex::add(const Recipe& recipe) {
+    vector<string> texts;
+    texts.reserve(recipe.getIngredients().size() + 1);
+    texts.push_back(recipe.getName());
+    for (const auto& ingredient : recipe.getIngredients()) {
+        texts.push_back(ingredient.getName());
+    }
+    
+    add(recipe.getId(), texts);
+}
+
+void TrigramIndex::add(int recipeId, const vector<string>& texts) {
+    if (recipeId <= 0) return;
+    
+    remove(recipeId);
+    
+    vector<uint32_t>& ids = recipeEntries_[recipeId];
+    for (const auto& text : texts) {
+        vector<Trigram> grams = trigrams(text);
+        if (grams.empty()) continue;
+        
+        // Новые записи получают номера больше прежних, списки остаются упорядоченными
+        uint32_t entry = static_cast<uint32_t>(entries_.size());
+        entries_.push_back({recipeId, static_cast<uint32_t>(grams.size())});
+        ids.push_back(entry);
+        
+        for (Trigram gram : grams) {
+            postings_[gram].push_back(entry);
+        }
+    }
+}
+
+void TrigramIndex::remove(int recipeId) {
+    auto it = recipeEntries_.find(recipeId);
+    if (it == recipeEntries_.end()) return;
+    
+    // Из списков триграмм записи не вычеркиваются сразу — поиск их пропускает,
+    // а когда удаленных становится много, индекс перестраивается
+    for (uint32_t entry : it->second) {
+        entries_[entry].recipeId = 0;
+    }
+    deadEntries_ += it->second.size();
+    recipeEntries_.erase(it);
+    
+    if (deadEntries_ > 1024 && deadEntries_ * 2 > entries_.size()) {
+        compact();
+    }
+}
+
+void TrigramIndex::compact() {
+    vector<uint32_t> renumbered(entries_.size(), UINT32_MAX);
+    vector<Entry> entries;
+    entries.reserve(entries_.size() - deadEntries_);
+    
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].recipeId != 0) {
+            renumbered[i] = static_cast<uint32_t>(entries.size());
+            entries.push_back(entries_[i]);
+        }
+    }
+    
+    // Перенумерация сохраняет порядок, поэтому списки остаются отсортированными
+    for (auto it = postings_.begin(); it != postings_.end();) {
+        vector<uint32_t>& list = it->second;
+        size_t kept = 0;
+        for (uint32_t entry : list) {
+            if (renumbered[entry] != UINT32_MAX) {
+                list[kept++] = renumbered[entry];
+            }
+        }
+        list.resize(kept);
+        
+        if (list.empty()) {
+            it = postings_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    for (auto& recipe : recipeEntries_) {
+        for (uint32_t& entry : recipe.second) {
+            entry = renumbered[entry];
+        }
+    }
+    
+    entries_ = move(entries);
+    deadEntries_ = 0;
+}
+
+vector<FuzzyMatch> TrigramIndex::search(const string& query, size_t limit, float threshold) const {
+    vector<Trigram> grams = trigrams(query);
+    if (grams.empty() || limit == 0) return {};
+    
+    static const vector<uint32_t> empty;
+    vector<const vector<uint32_t>*> lists;
+    lists.reserve(grams.size());
+    for (Trigram gram : grams) {
+        auto it = postings_.find(gram);
+        lists.push_back(it != postings_.end() ? &it->second : &empty);
+    }
+    sort(lists.begin(), lists.end(), [](const vector<uint32_t>* a, const vector<uint32_t>* b) {
+        return a->size() < b->size();
+    });
+    
+    // Записи нужно хотя бы required общих триграмм, значит она обязательно
+    // встретится в одном из (n - required + 1) самых коротких списков.
+    // Кандидаты набираются только из них, длинные списки лишь досчитывают совпадения
+    size_t total = grams.size();
+    size_t required = max<size_t>(1, static_cast<size_t>(ceil(threshold * total)));
+    size_t probing = total - min(required, total) + 1;
+    
+    vector<uint8_t> shared(entries_.size(), 0);
+    for (size_t i = 0; i < total; ++i) {
+        bool collect = i < probing;
+        for (uint32_t entry : *lists[i]) {
+            if (collect || shared[entry]) {
+                shared[entry] = static_cast<uint8_t>(min<size_t>(shared[entry] + 1, UINT8_MAX));
+            }
+        }
+    }
+    
+    // Записи одного рецепта идут подряд — лучшая из них выбирается за один проход
+    vector<FuzzyMatch> matches;
+    for (size_t entry = 0; entry < entries_.size(); ++entry) {
+        if (shared[entry] < required) continue;
+        
+        const Entry& info = entries_[entry];
+        if (info.recipeId == 0) continue;
+        
+        // Основной вес — доля найденных триграмм запроса; при равенстве выше
+        // записи, где мало лишнего (сходство по Жаккару)
+        float containment = static_cast<float>(shared[entry]) / total;
+        float jaccard = static_cast<float>(shared[entry]) / (total + info.trigramCount - shared[entry]);
+        float score = containment * 0.99f + jaccard * 0.01f;
+        
+        if (!matches.empty() && matches.back().recipeId == info.recipeId) {
+            matches.back().similarity = max(matches.back().similarity, score);
+        } else {
+            matches.push_back({info.recipeId, score});
+        }
+    }
+    
+    auto better = [](const FuzzyMatch& a, const FuzzyMatch& b) {
+        if (a.similarity != b.similarity) return a.similarity > b.similarity;
+        return a.recipeId < b.recipeId;
+    };
+    if (matches.size() > limit) {
+        partial_sort(matches.begin(), matches.begin() + limit, matches.end(), better);
+        matches.resize(limit);
+    } else {
+        sort(matches.begin(), matches.end(), better);
+    }
+    
+    return matches;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+using namespace std;
+
+class Recipe;
+
+// Похожий по написанию рецепт: similarity от 0 до 1 — в основном доля триграмм
+// запроса, найденных в названии рецепта или одного из его ингредиентов
+struct FuzzyMatch {
+    int recipeId;
+    float similarity;
+};
+
+// Нечеткий поиск по названиям рецептов и ингредиентов: триграммы символов
+// (как в pg_trgm) после foldText, поэтому регистр и "ё" не важны, а опечатка
+// портит только несколько триграмм. Обновляется по одному рецепту.
+// Чтение из нескольких потоков безопасно, пока индекс не изменяется
+class TrigramIndex {
+public:
+    void clear();
+    
+    // Добавляет рецепт или заменяет его тексты
+    void add(const Recipe& recipe);
+    void add(int recipeId, const vector<string>& texts);
+    void remove(int recipeId);
+    
+    // Лучшие limit рецептов, в которых найдено не меньше threshold триграмм запроса
+    vector<FuzzyMatch> search(const string& query, size_t limit, float threshold = 0.5f) const;
+
+private:
+    using Trigram = uint64_t;
+    
+    struct Entry {
+        int recipeId;           // 0 — запись удалена
+        uint32_t trigramCount;
+    };
+    
+    static vector<Trigram> trigrams(const string& text);
+    void compact();
+    
+    vector<Entry> entries_;
+    unordered_map<Trigram, vector<uint32_t>> postings_;     // номера записей по возрастанию
+    unordered_map<int, vector<uint32_t>> recipeEntries_;
+    size_t deadEntries_ = 0;
+};
\ No newline at end of file
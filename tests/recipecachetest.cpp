@@ -0,0 +1,75 @@
+#include "recipecache.h"
+#include <iostream>
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        cerr << "НЕ ВЫПОЛНЕНО: " << what << endl;
+        ++failures;
+    }
+}
+
+static Recipe makeRecipe(int id, const string& name) {
+    Recipe recipe(name);
+    recipe.setId(id);
+    return recipe;
+}
+
+// Запоздавшее асинхронное чтение версии v приходит после записи v+1
+static void staleReadKeepsNewerEntry() {
+    RecipeCache cache(4);
+    cache.setTracking(true);
+    
+    cache.put(makeRecipe(1, "Новое название"), 2);
+    cache.put(makeRecipe(1, "Старое название"), 1);
+    
+    int checkVersion = -1;
+    int version = 0;
+    shared_ptr<Recipe> recipe = cache.find(1, &checkVersion, &version);
+    check(recipe && recipe->getName() == "Новое название", "после версии 2 версия 1 не заменяет рецепт");
+    check(version == 2, "в кэше остается версия 2");
+    check(checkVersion == 0, "новая запись не требует сверки");
+}
+
+static void newerVersionReplacesEntry() {
+    RecipeCache cache(4);
+    cache.setTracking(true);
+    
+    cache.put(makeRecipe(1, "Было"), 1);
+    cache.put(makeRecipe(1, "Стало"), 2);
+    
+    int checkVersion = -1;
+    int version = 0;
+    shared_ptr<Recipe> recipe = cache.find(1, &checkVersion, &version);
+    check(recipe && recipe->getName() == "Стало", "версия 2 заменяет версию 1");
+    check(version == 2, "в кэше версия 2");
+}
+
+static void staleReadStillCountsAsUse() {
+    RecipeCache cache(2);
+    cache.put(makeRecipe(1, "Первый"), 2);
+    cache.put(makeRecipe(2, "Второй"), 1);
+    
+    // Отвергнутое чтение все равно поднимает запись в начало очереди вытеснения
+    cache.put(makeRecipe(1, "Первый, старый"), 1);
+    cache.put(makeRecipe(3, "Третий"), 1);
+    
+    int checkVersion = 0;
+    check(cache.find(1, &checkVersion) != nullptr, "недавно тронутая запись не вытеснена");
+    check(cache.find(2, &checkVersion) == nullptr, "вытеснена давняя запись");
+}
+
+int main() {
+    staleReadKeepsNewerEntry();
+    newerVersionReplacesEntry();
+    staleReadStillCountsAsUse();
+    
+    if (failures) {
+        cerr << "Провалено проверок: " << failures << endl;
+        return 1;
+    }
+    cout << "RecipeCache: все проверки пройдены" << endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "textfold.h"
+#include "trigramindex.h"
+#include <iostream>
+using namespace std;
+
+static int failures = 0;
+
+static void checkFold(const string& text, const string& expected) {
+    string folded = foldText(text);
+    if (folded != expected) {
+        cerr << "НЕ ВЫПОЛНЕНО: foldText(\"" << text << "\") = \"" << folded << "\", ожидалось \"" << expected << "\"" << endl;
+        ++failures;
+    }
+}
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        cerr << "НЕ ВЫПОЛНЕНО: " << what << endl;
+        ++failures;
+    }
+}
+
+int main() {
+    // Латиница, русский, пробелы
+    checkFold("  Борщ   UKRAINIAN\tstyle ", "борщ ukrainian style");
+    checkFold("ЁЖИК ёлка", "ежик елка");
+    
+    // Кириллица за пределами русского алфавита
+    checkFold("Їжа", "їжа");
+    checkFold("ЄВРО ҐАНОК ІРИС", "євро ґанок ірис");
+    checkFold("ЎЗВАР", "ўзвар");
+    checkFold("ЂАЧКИ ЉУБАВ ЊЕГОШ ЋЕВАП ЏЕМ", "ђачки љубав његош ћевап џем");
+    checkFold("ЍЀ", "ѝѐ");
+    checkFold("ѢѲ ҒҚҮ ӘӨ Ӏ ӁӃ", "ѣѳ ғқү әө ӏ ӂӄ");
+    
+    // Latin-1, Extended-A, греческий
+    checkFold("CRÈME BRÛLÉE ÆØÅ ×ß", "crème brûlée æøå ×ß");
+    checkFold("ŻUREK ŁÓDŹ ŠČŘ Ÿ", "żurek łódź ščř ÿ");
+    checkFold("ΣΟΥΒΛΑΚΙ Ά ΈΉΊ Ό ΎΏ ς", "σουβλακι ά έήί ό ύώ σ");
+    
+    // Строчные, знаки и неполная последовательность UTF-8 не меняются
+    checkFold("їжа, 100 г; €", "їжа, 100 г; €");
+    checkFold("\xD0", "\xD0");
+    
+    // Нечеткий поиск находит название независимо от регистра нерусской буквы
+    TrigramIndex index;
+    index.add(1, {"Їжа з печі"});
+    vector<FuzzyMatch> matches = index.search("їжа з печі", 10);
+    check(!matches.empty() && matches[0].recipeId == 1, "\"їжа з печі\" находит \"Їжа з печі\"");
+    
+    if (failures) {
+        cerr << "Провалено проверок: " << failures << endl;
+        return 1;
+    }
+    cout << "foldText: все проверки пройдены" << endl;
+    return 0;
+}
\ No newline at end of file